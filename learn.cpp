@@ -2,10 +2,57 @@
 // Interactive C++ Learning Tool (English & Arabic)
 // Terminal-based, single file, progressive lessons by level
 // Author: AI Assistant
-// C++11 or newer required
+// C++17 or newer and a POSIX system (Linux/macOS) required
 //
 // Usage: Compile and run in terminal
-// g++ -std=c++11 learn.cpp -o learn && ./learn
+// g++ -std=c++17 -pthread learn.cpp -o learn && ./learn
+// Adding -O2 -DLEARN_BENCHMARK builds a microbenchmark runner instead
+// (catalog build, dispatch, grading, persistence, notes, rendering), which
+// writes its results as JSON.
+//
+// Lesson packs: ./learn --export-pack en lessons_en.pack writes the built-in
+// English catalog as a pack; lessons_<en|ar>.pack files in the current
+// directory (or --pack-dir <dir>) are used instead of the built-in catalogs.
+// Languages are listed in one registry and only the one a session picks is
+// loaded. On Linux, replacing a pack, saving an instructor edit or changing an
+// imported lesson file reloads the lessons in running sessions.
+//
+// Progress for every learner lives in one shared store (progress.db, or
+// --store <file>); the learner defaults to $LEARN_LEARNER or $USER and can be
+// set with --learner <id>. Graded answers, skips and solution reveals are
+// logged per learner under events/; ./learn --analyze summarizes them per
+// lesson (pass rate, answer times, where learners stop).
+//
+// Graded lessons are scheduled for review with SM-2 (reviews/, per learner):
+// the end-of-level quiz asks the level's due lessons first, and "due" runs
+// the day's reviews across every level.
+//
+// "run" compiles the learner's own program with the local g++ and checks
+// what it prints against the lesson's expected output. It runs sandboxed,
+// with no network and with time and memory limits. Builds are cached in
+// compile-cache/ next to the store. ./learn --verify-catalog builds and runs
+// every lesson's sample code on all cores and reports which fail to compile
+// or print something other than their expected output.
+//
+// Every third session the store is backed up in the background to numbered,
+// compressed snapshots in <store>.snapshots/ (deltas against the previous
+// one; the newest 8 are kept, --backup-generations N). ./learn --backups
+// lists and verifies them; ./learn --restore-backup <generation> restores one.
+//
+// Each phase of the lesson loop (render, input, dispatch, persistence) and
+// each command is timed into latency histograms, written in Prometheus text
+// format to metrics.prom next to the store (or --metrics <file>) on exit and
+// whenever the process gets SIGUSR1.
+//
+// Batch mode: ./learn --batch script.txt [--repeat N] [--transcript out.jsonl]
+// runs the lesson loop from a script (one input per line, "-" for stdin)
+// with no animation, screen clears or pauses, and writes a JSON-lines
+// transcript plus a per-command timing summary. Progress stays in memory
+// unless --store is given; --echo keeps the screen output.
+//
+// Server mode (Linux): ./learn --serve /tmp/learn.sock [--workers N] serves
+// many learners from one process; each runs ./learn --connect /tmp/learn.sock
+// [--learner <id>] as a thin client.
 
 #include <iostream>
 #include <string>
@@ -20,24 +67,156 @@
 #include <iomanip>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <map>
+#include <random>
+#include <deque>
+#include <numeric>
+#include <future>
+#include <queue>
+#include <string_view>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sched.h>
+#include <ucontext.h>
+#endif
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+// --- Interned Text ---
+// Lesson text is held as InternedText: a view of bytes that never move and
+// never change. The built-in catalogs point straight at their string
+// literals (the compiler keeps one copy of each distinct literal); text read
+// at run time (imports, instructor edits, pack levels copied for editing) is
+// interned into g_text_arena, so identical fields share one copy whatever
+// their lesson or level. A Lesson is therefore a fixed-size, trivially
+// copyable record. The arena only grows; its content is the catalog text
+// seen by this process, which is small and mostly repeats.
+class TextArena {
+public:
+    TextArena() {}
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+
+    // The stored copy of s, added on first sight
+    std::string_view intern(std::string_view s) {
+        if (s.empty()) return std::string_view();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(s);
+        if (it != index_.end()) return *it;
+        char* p = allocate(s.size());
+        std::memcpy(p, s.data(), s.size());
+        std::string_view stored(p, s.size());
+        index_.insert(stored);
+        bytes_ += s.size();
+        return stored;
+    }
+
+    size_t count() const { std::lock_guard<std::mutex> lock(mutex_); return index_.size(); }
+    size_t bytes() const { std::lock_guard<std::mutex> lock(mutex_); return bytes_; }
+
+private:
+    static const size_t kChunkSize = 64 * 1024;
+
+    // Small strings are packed into shared chunks; large ones get their own block
+    char* allocate(size_t n) {
+        if (n > kChunkSize / 4) {
+            blocks_.emplace_back(new char[n]);
+            return blocks_.back().get();
+        }
+        if (chunks_.empty() || chunk_used_ + n > kChunkSize) {
+            chunks_.emplace_back(new char[kChunkSize]);
+            chunk_used_ = 0;
+        }
+        char* p = chunks_.back().get() + chunk_used_;
+        chunk_used_ += n;
+        return p;
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_set<std::string_view> index_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t chunk_used_ = 0;
+    size_t bytes_ = 0;
+};
+
+TextArena g_text_arena;
+
+class InternedText {
+public:
+    constexpr InternedText() {}
+    // String literals are static already and are used in place
+    template <size_t N>
+    constexpr InternedText(const char (&literal)[N]) : text_(literal, N - 1) {}
+
+    static InternedText intern(std::string_view s) {
+        InternedText t;
+        t.text_ = g_text_arena.intern(s);
+        return t;
+    }
+
+    operator std::string_view() const { return text_; }
+    std::string_view view() const { return text_; }
+    const char* data() const { return text_.data(); }
+    size_t size() const { return text_.size(); }
+    bool empty() const { return text_.empty(); }
+
+private:
+    std::string_view text_;
+};
 
 // --- Localization Structures ---
 struct Lesson {
-    std::string explanation;
-    std::string code;
-    std::string challenge;
-    std::string solution;
-    std::string expected_output;
-    std::string hint;
-    std::string related_title;
-    std::string related_level;
+    InternedText explanation;
+    InternedText code;
+    InternedText challenge;
+    InternedText solution;
+    InternedText expected_output;
+    InternedText hint;
+    InternedText related_title;
+    InternedText related_level;
 };
+static_assert(std::is_trivially_copyable<Lesson>::value, "Lesson must stay a plain record of views");
 
 struct Level {
     std::string name;
     std::vector<Lesson> lessons;
 };
 
+class LessonPack;
+struct BuiltinCatalog;
+
+// Instructor overrides for one lesson (see Instructor Overlay)
+struct LessonPatch {
+    uint8_t mask = 0;  // bit f set: fields[f] replaces Lesson field f
+    InternedText fields[8];
+};
+
 struct Localization {
     // UI Strings
     std::string select_language;
@@ -68,805 +247,7349 @@ struct Localization {
     std::string bookmark_loaded;
     std::string weekly_stats;
     std::string backup_created;
+    std::string xp_earned;
+    std::string daily_goal_progress;
+    std::string daily_goal_reached;
+    std::string no_bookmark;
+    std::string search_prompt;
+    std::string search_none;
+    std::string search_open;
     // Welcome message for typing animation
     std::string welcome_message;
     std::vector<Level> levels;
+    // Set when lessons are served from a mapped lesson pack
+    std::shared_ptr<LessonPack> pack;
+    // Set when lessons are served in place from a built-in catalog
+    const BuiltinCatalog* builtin = nullptr;
+    // Instructor edits laid over the lessons, by patch_key(level, lesson)
+    std::unordered_map<uint64_t, LessonPatch> patches;
+};
+
+uint64_t patch_key(int level, int lesson) {
+    return ((uint64_t)(uint32_t)level << 32) | (uint32_t)lesson;
+}
+
+// UI string order inside a pack. Append only: packs written by older builds
+// simply carry fewer entries and the rest fall back to the built-in catalog.
+std::string Localization::* const kUiStrings[] = {
+    &Localization::select_language, &Localization::select_level, &Localization::beginner,
+    &Localization::intermediate, &Localization::advanced, &Localization::prompt_command,
+    &Localization::invalid_command, &Localization::lesson_header, &Localization::code_header,
+    &Localization::challenge_header, &Localization::solution_header, &Localization::goodbye,
+    &Localization::commands_hint, &Localization::back_first, &Localization::next_last,
+    &Localization::related_topic, &Localization::note_prompt, &Localization::note_saved,
+    &Localization::notes_header, &Localization::no_notes, &Localization::reminder_message,
+    &Localization::instructor_mode, &Localization::instructor_password, &Localization::bookmark_saved,
+    &Localization::bookmark_loaded, &Localization::weekly_stats, &Localization::backup_created,
+    &Localization::welcome_message, &Localization::xp_earned, &Localization::daily_goal_progress,
+    &Localization::daily_goal_reached, &Localization::no_bookmark, &Localization::search_prompt,
+    &Localization::search_none, &Localization::search_open
+};
+const uint32_t kUiStringCount = sizeof(kUiStrings) / sizeof(kUiStrings[0]);
+
+// A catalog compiled into the program: constexpr tables in read-only data,
+// shared by every running learn process. The tables are constant-initialized,
+// so they add no static constructors (the program's services and other
+// globals still have theirs), and no catalog text is allocated until a
+// language is selected; even then only the UI strings and level names are
+// copied, and lessons are read in place (like a mapped pack) until a level
+// is edited.
+struct BuiltinLevel {
+    std::string_view name;
+    const Lesson* lessons;
+    size_t lesson_count;
+};
+
+struct BuiltinCatalog {
+    std::string_view ui[kUiStringCount];  // kUiStrings order
+    const BuiltinLevel* levels;
+    size_t level_count;
 };
 
 // --- English Content ---
-Localization en = {
-    // UI Strings
-    "Select language / اختر اللغة:\n1) English\n2) العربية",
-    "Select your current level:\n1) Beginner 👶\n2) Intermediate 🧑‍💻\n3) Advanced 👨‍🏫",
-    "Beginner",
-    "Intermediate",
-    "Advanced",
-    "Type a command (next, back, repeat, code, solution, exit, note, notes, bookmark, goto, mode): ",
-    "Invalid command. Please try again.",
-    "\n--- Lesson ",
-    "\nSample Code:",
-    "\nMini Challenge:",
-    "\nSolution:",
-    "Goodbye! Happy learning!",
-    "[Commands: next, back, repeat, code, solution, exit, note, notes, bookmark, goto, mode]",
-    "You are at the first lesson.",
-    "You are at the last lesson.",
-    // New UI strings for features
-    "💡 Related Topic: ",
-    "Enter your note for this lesson: ",
-    "✅ Note saved successfully!",
-    "\n📝 Your Notes:",
-    "No notes found.",
-    "⏰ It's been {days} days since your last session. Ready to continue?",
-    "👨‍🏫 Instructor Mode",
-    "Enter instructor password: ",
-    "🔖 Bookmark saved at lesson ",
-    "🔖 Jumped to bookmarked lesson ",
-    "📊 Weekly Statistics Summary",
-    "🔁 Progress backup created successfully!",
-    // Welcome message for typing animation
-    "Hello! I'm your personal programming instructor.\nI'll guide you in learning C++ in your favorite language!\nCreated with care by your developer, Othman Mohamed. Let's get started! 💻🚀",
-    // Levels & Lessons
+constexpr Lesson kEnglishBeginner[] = {
+    {"What is programming?\nProgramming is giving instructions to a computer to perform tasks.", "// No code for this concept.", "What is programming in your own words?", "Programming is telling a computer what to do using code.", "Programming is telling a computer what to do using code.", "A program is a set of instructions that tells the computer what to do."},
+    {"What is C++?\nC++ is a powerful programming language used for building software, games, and more.", "// No code for this concept.", "Name one thing you can build with C++.", "Games, applications, operating systems, etc.", "Games, applications, operating systems, etc.", "You can build games, applications, and operating systems."},
+    {"Hello World!\nThe first program in any language prints a message.", "#include <iostream>\nint main() {\n    std::cout << \"Hello, World!\\n\";\n    return 0;\n}", "What does this program print?", "Hello, World!", "Hello, World!", "Look at the string inside cout."},
+    {"Input and Output\nYou can read and print values using std::cin and std::cout.", "#include <iostream>\nint main() {\n    int age;\n    std::cout << \"Enter your age: \";\n    std::cin >> age;\n    std::cout << \"You are \" << age << \" years old.\\n\";\n    return 0;\n}", "How do you print a value in C++?", "Using std::cout.", "Using std::cout.", "Remember to include iostream for cin and cout."},
+    {"Variables and Types\nVariables store data. C++ has types like int, double, char.", "int x = 5;\ndouble y = 3.14;\nchar c = 'A';", "What type would you use for a decimal number?", "double", "double", "Use double for decimal numbers."},
+    {"If/Else\nUse if/else to make decisions.", "int x = 10;\nif (x > 5) {\n    std::cout << \"x is greater than 5\\n\";\n} else {\n    std::cout << \"x is 5 or less\\n\";\n}", "What does this code print if x = 3?", "x is 5 or less", "x is 5 or less", "Remember to use double quotes for strings."}
+};
+
+constexpr Lesson kEnglishIntermediate[] = {
+    {"Loops\nLoops repeat actions. For example, a for loop.", "for (int i = 0; i < 5; ++i) { std::cout << i << \" \"; }", "How many times does this loop run?", "5 times (i = 0 to 4)", "5 times (i = 0 to 4)", "The loop will run from i=0 to i=4."},
+    {"Functions\nFunctions group code to perform tasks.", "int add(int a, int b) {\n    return a + b;\n}\n// Usage:\nint sum = add(2, 3);", "What does add(2, 3) return?", "5", "5", "Remember to return the value from the function.", "Classes & OOP", "Advanced 👨‍🏫"},
+    {"Arrays\nArrays store multiple values of the same type.", "int arr[3] = {1, 2, 3};\nstd::cout << arr[1]; // prints 2", "What does arr[2] equal?", "3", "3", "Arrays are 0-indexed."},
+    {"Switch\nSwitch selects code to run based on a value.", "int day = 2;\nswitch(day) {\n    case 1: std::cout << \"Mon\"; break;\n    case 2: std::cout << \"Tue\"; break;\n    default: std::cout << \"Other\";\n}", "What does this print if day = 2?", "Tue", "Tue", "Remember to use break to exit the case."},
+    {"Error Handling Basics\nUse try/catch to handle errors.", "try {\n    throw std::runtime_error(\"Error!\");\n} catch (const std::exception& e) {\n    std::cout << e.what();\n}", "What does e.what() print?", "Error!", "Error!", "Remember to include iostream for cin and cout."}
+};
+
+constexpr Lesson kEnglishAdvanced[] = {
+    {"Classes & OOP\nClasses group data and functions.", "class Person {\npublic:\n    std::string name;\n    void say_hello() {\n        std::cout << \"Hello, I am \" << name << std::endl;\n    }\n};", "How do you call say_hello on a Person p?", "p.say_hello();", "p.say_hello();", "Remember to use std::endl for a newline."},
+    {"Pointers & Memory\nPointers store addresses of variables.", "int x = 10;\nint* p = &x;\nstd::cout << *p; // prints 10", "What does *p print?", "10", "10", "Remember to use *p to access the value at the address."},
+    {"File Handling\nRead/write files using fstream.", "#include <fstream>\nstd::ofstream out(\"file.txt\");\nout << \"Hello\";\nout.close();", "Which header is needed for file streams?", "<fstream>", "<fstream>", "Remember to include fstream for file operations."},
+    {"STL\nThe Standard Template Library provides useful containers.", "#include <vector>\nstd::vector<int> v = {1,2,3};\nv.push_back(4);", "How do you add an element to a vector?", "v.push_back(value);", "v.push_back(value);", "Remember to use v.push_back() to add elements."},
+    {"Mini Project\nCombine what you learned!\nWrite a program that asks for 3 numbers and prints their sum.", "#include <iostream>\nint main() {\n    int a, b, c;\n    std::cin >> a >> b >> c;\n    std::cout << (a + b + c);\n    return 0;\n}", "What does this program do?", "Reads 3 numbers and prints their sum.", "Reads 3 numbers and prints their sum.", "Remember to use cin for input and cout for output."}
+};
+
+constexpr BuiltinLevel kEnglishLevels[] = {
+    {"Beginner 👶", kEnglishBeginner, sizeof(kEnglishBeginner) / sizeof(Lesson)},
+    {"Intermediate 🧑‍💻", kEnglishIntermediate, sizeof(kEnglishIntermediate) / sizeof(Lesson)},
+    {"Advanced 👨‍🏫", kEnglishAdvanced, sizeof(kEnglishAdvanced) / sizeof(Lesson)},
+};
+
+constexpr BuiltinCatalog kEnglishCatalog = {
     {
-        { // Beginner
-            "Beginner 👶",
-            {
-                {"What is programming?\nProgramming is giving instructions to a computer to perform tasks.", "// No code for this concept.", "What is programming in your own words?", "Programming is telling a computer what to do using code.", "Programming is telling a computer what to do using code.", "A program is a set of instructions that tells the computer what to do."},
-                {"What is C++?\nC++ is a powerful programming language used for building software, games, and more.", "// No code for this concept.", "Name one thing you can build with C++.", "Games, applications, operating systems, etc.", "Games, applications, operating systems, etc.", "You can build games, applications, and operating systems."},
-                {"Hello World!\nThe first program in any language prints a message.", "#include <iostream>\nint main() {\n    std::cout << \"Hello, World!\\n\";\n    return 0;\n}", "What does this program print?", "Hello, World!", "Hello, World!", "Look at the string inside cout."},
-                {"Input and Output\nYou can read and print values using std::cin and std::cout.", "#include <iostream>\nint main() {\n    int age;\n    std::cout << \"Enter your age: \";\n    std::cin >> age;\n    std::cout << \"You are \" << age << \" years old.\\n\";\n    return 0;\n}", "How do you print a value in C++?", "Using std::cout.", "Using std::cout.", "Remember to include iostream for cin and cout."},
-                {"Variables and Types\nVariables store data. C++ has types like int, double, char.", "int x = 5;\ndouble y = 3.14;\nchar c = 'A';", "What type would you use for a decimal number?", "double", "double", "Use double for decimal numbers."},
-                {"If/Else\nUse if/else to make decisions.", "int x = 10;\nif (x > 5) {\n    std::cout << \"x is greater than 5\\n\";\n} else {\n    std::cout << \"x is 5 or less\\n\";\n}", "What does this code print if x = 3?", "x is 5 or less", "x is 5 or less", "Remember to use double quotes for strings."}
-            }
-        },
-        { // Intermediate
-            "Intermediate 🧑‍💻",
-            {
-                {"Loops\nLoops repeat actions. For example, a for loop.", "for (int i = 0; i < 5; ++i) { std::cout << i << \" \"; }", "How many times does this loop run?", "5 times (i = 0 to 4)", "5 times (i = 0 to 4)", "The loop will run from i=0 to i=4."},
-                {"Functions\nFunctions group code to perform tasks.", "int add(int a, int b) {\n    return a + b;\n}\n// Usage:\nint sum = add(2, 3);", "What does add(2, 3) return?", "5", "5", "Remember to return the value from the function.", "Classes & OOP", "Advanced 👨‍🏫"},
-                {"Arrays\nArrays store multiple values of the same type.", "int arr[3] = {1, 2, 3};\nstd::cout << arr[1]; // prints 2", "What does arr[2] equal?", "3", "3", "Arrays are 0-indexed."},
-                {"Switch\nSwitch selects code to run based on a value.", "int day = 2;\nswitch(day) {\n    case 1: std::cout << \"Mon\"; break;\n    case 2: std::cout << \"Tue\"; break;\n    default: std::cout << \"Other\";\n}", "What does this print if day = 2?", "Tue", "Tue", "Remember to use break to exit the case."},
-                {"Error Handling Basics\nUse try/catch to handle errors.", "try {\n    throw std::runtime_error(\"Error!\");\n} catch (const std::exception& e) {\n    std::cout << e.what();\n}", "What does e.what() print?", "Error!", "Error!", "Remember to include iostream for cin and cout."}
-            }
-        },
-        { // Advanced
-            "Advanced 👨‍🏫",
-            {
-                {"Classes & OOP\nClasses group data and functions.", "class Person {\npublic:\n    std::string name;\n    void say_hello() {\n        std::cout << \"Hello, I am \" << name << std::endl;\n    }\n};", "How do you call say_hello on a Person p?", "p.say_hello();", "p.say_hello();", "Remember to use std::endl for a newline."},
-                {"Pointers & Memory\nPointers store addresses of variables.", "int x = 10;\nint* p = &x;\nstd::cout << *p; // prints 10", "What does *p print?", "10", "10", "Remember to use *p to access the value at the address."},
-                {"File Handling\nRead/write files using fstream.", "#include <fstream>\nstd::ofstream out(\"file.txt\");\nout << \"Hello\";\nout.close();", "Which header is needed for file streams?", "<fstream>", "<fstream>", "Remember to include fstream for file operations."},
-                {"STL\nThe Standard Template Library provides useful containers.", "#include <vector>\nstd::vector<int> v = {1,2,3};\nv.push_back(4);", "How do you add an element to a vector?", "v.push_back(value);", "v.push_back(value);", "Remember to use v.push_back() to add elements."},
-                {"Mini Project\nCombine what you learned!\nWrite a program that asks for 3 numbers and prints their sum.", "#include <iostream>\nint main() {\n    int a, b, c;\n    std::cin >> a >> b >> c;\n    std::cout << (a + b + c);\n    return 0;\n}", "What does this program do?", "Reads 3 numbers and prints their sum.", "Reads 3 numbers and prints their sum.", "Remember to use cin for input and cout for output."}
-            }
-        }
-    }
+        // UI Strings
+        "Select language / اختر اللغة:\n1) English\n2) العربية",
+        "Select your current level:\n1) Beginner 👶\n2) Intermediate 🧑‍💻\n3) Advanced 👨‍🏫",
+        "Beginner",
+        "Intermediate",
+        "Advanced",
+        "Type a command (next, back, repeat, code, solution, exit, note, notes, bookmark, goto, mode, search, due, run): ",
+        "Invalid command. Please try again.",
+        "\n--- Lesson ",
+        "\nSample Code:",
+        "\nMini Challenge:",
+        "\nSolution:",
+        "Goodbye! Happy learning!",
+        "[Commands: next, back, repeat, code, solution, exit, note, notes, bookmark, goto, mode, search, due, run]",
+        "You are at the first lesson.",
+        "You are at the last lesson.",
+        // New UI strings for features
+        "💡 Related Topic: ",
+        "Enter your note for this lesson: ",
+        "✅ Note saved successfully!",
+        "\n📝 Your Notes:",
+        "No notes found.",
+        "⏰ It's been {days} days since your last session. Ready to continue?",
+        "👨‍🏫 Instructor Mode",
+        "Enter instructor password: ",
+        "🔖 Bookmark saved at lesson ",
+        "🔖 Jumped to bookmarked lesson ",
+        "📊 Weekly Statistics Summary",
+        "🔁 Progress backup created successfully!",
+        // Welcome message for typing animation
+        "Hello! I'm your personal programming instructor.\nI'll guide you in learning C++ in your favorite language!\nCreated with care by your developer, Othman Mohamed. Let's get started! 💻🚀",
+        // Rewards and search
+        "✅ You earned 10 XP! Total: ",
+        "✅ You've completed {done}/{goal} of your daily goal!",
+        "🎉 Daily goal achieved! You’re crushing it!",
+        "❌ No bookmark set!",
+        "Search for: ",
+        "🔍 No lessons match your search.",
+        "Enter a result number to open it, or press Enter to go back: ",
+    },
+    kEnglishLevels,
+    sizeof(kEnglishLevels) / sizeof(BuiltinLevel)
 };
+static_assert(!kEnglishCatalog.ui[kUiStringCount - 1].empty(), "one UI string per kUiStrings entry");
 
 // --- Arabic Content ---
-Localization ar = {
-    // UI Strings
-    "اختر اللغة / Select language:\n1) English\n2) العربية",
-    "اختر مستواك الحالي:\n1) مبتدئ 👶\n2) متوسط 🧑‍💻\n3) متقدم 👨‍🏫",
-    "مبتدئ",
-    "متوسط",
-    "متقدم",
-    "اكتب أمر (التالي، السابق، إعادة، الكود، الحل، خروج، ملاحظة، ملاحظات، علامة، اذهب، وضع): ",
-    "أمر غير صالح. حاول مرة أخرى.",
-    "\n--- الدرس ",
-    "\nمثال الكود:",
-    "\nتحدي صغير:",
-    "\nالحل:",
-    "وداعاً! تعلم سعيد!",
-    "[الأوامر: التالي، السابق، إعادة، الكود، الحل، خروج، ملاحظة، ملاحظات، علامة، اذهب، وضع]",
-    "أنت في أول درس.",
-    "أنت في آخر درس.",
-    // New UI strings for features
-    "💡 موضوع ذو صلة: ",
-    "أدخل ملاحظتك لهذا الدرس: ",
-    "✅ تم حفظ الملاحظة بنجاح!",
-    "\n📝 ملاحظاتك:",
-    "لا توجد ملاحظات.",
-    "⏰ مر {days} أيام منذ جلستك الأخيرة. مستعد للمتابعة؟",
-    "👨‍🏫 وضع المحاضر",
-    "أدخل كلمة مرور المحاضر: ",
-    "🔖 تم حفظ العلامة في الدرس ",
-    "🔖 انتقل إلى الدرس المحدد ",
-    "📊 ملخص الإحصائيات الأسبوعية",
-    "🔁 تم إنشاء نسخة احتياطية بنجاح!",
-    // Welcome message for typing animation
-    "أهلاً! أنا أستاذك الخاص في تعلم البرمجة.\nسأرشدك في تعلم ++C بلغتك المفضلة!\nتم تطويري بحب بواسطة مطورك عثمان محمد. هيا نبدأ! 💻🚀",
-    // Levels & Lessons
+constexpr Lesson kArabicBeginner[] = {
+    {"ما البرمجة؟\nالبرمجة هي إعطاء أوامر للحاسوب لتنفيذ مهام.", "// لا يوجد كود لهذا المفهوم.", "ما هي البرمجة بكلماتك؟", "البرمجة هي إخبار الحاسوب بما يجب فعله باستخدام الكود.", "البرمجة هي إخبار الحاسوب بما يجب فعله باستخدام الكود.", "البرمجة هي إخبار الحاسوب بما يجب فعله باستخدام الكود."},
+    {"ما هي ++C؟\n++C لغة برمجة قوية لبناء البرامج والألعاب والمزيد.", "// لا يوجد كود لهذا المفهوم.", "اذكر شيئاً يمكن بناؤه بـ ++C.", "ألعاب، تطبيقات، أنظمة تشغيل، إلخ.", "ألعاب، تطبيقات، أنظمة تشغيل، إلخ.", "يمكنك بناء ألعاب، تطبيقات، أنظمة تشغيل."},
+    {"برنامج Hello World!\nأول برنامج يطبع رسالة.", "#include <iostream>\nint main() {\n    std::cout << \"Hello, World!\\n\";\n    return 0;\n}", "ماذا يطبع هذا البرنامج؟", "Hello, World!", "Hello, World!", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."},
+    {"الإدخال والإخراج\nيمكنك قراءة وطباعة القيم باستخدام std::cin و std::cout.", "#include <iostream>\nint main() {\n    int age;\n    std::cout << \"أدخل عمرك: \";\n    std::cin >> age;\n    std::cout << \"عمرك \" << age << \" سنة.\\n\";\n    return 0;\n}", "كيف تطبع قيمة في ++C؟", "باستخدام std::cout.", "باستخدام std::cout.", "تأكد من أنك قمت بطباعة القيمة باستخدام std::cout."},
+    {"المتغيرات والأنواع\nالمتغيرات تخزن البيانات. ++C بها أنواع مثل int, double, char.", "int x = 5;\ndouble y = 3.14;\nchar c = 'A';", "أي نوع تستخدمه للعدد العشري؟", "double", "double", "استخدم double للأرقام العشرية."},
+    {"if/else\nاستخدم if/else لاتخاذ قرارات.", "int x = 10;\nif (x > 5) {\n    std::cout << \"x أكبر من 5\\n\";\n} else {\n    std::cout << \"x أقل أو يساوي 5\\n\";\n}", "ماذا يطبع الكود إذا كان x = 3؟", "x أقل أو يساوي 5", "x أقل أو يساوي 5", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."}
+};
+
+constexpr Lesson kArabicIntermediate[] = {
+    {"الحلقات\nالحلقات تكرر الأوامر. مثال: حلقة for.", "for (int i = 0; i < 5; ++i) { std::cout << i << \" \"; }", "كم مرة تعمل هذه الحلقة؟", "5 مرات (i = 0 إلى 4)", "5 مرات (i = 0 إلى 4)", "تأكد من أنك قمت بطباعة الرقم باستخدام std::cout."},
+    {"الدوال\nالدوال تجمع كوداً لتنفيذ مهمة.", "int add(int a, int b) {\n    return a + b;\n}\n// الاستخدام:\nint sum = add(2, 3);", "ماذا تعيد add(2, 3)؟", "5", "5", "تأكد من أنك قمت بإرجاع القيمة باستخدام return.", "الكائنات والبرمجة الكائنية", "متقدم 👨‍🏫"},
+    {"المصفوفات\nالمصفوفة تخزن عدة قيم من نفس النوع.", "int arr[3] = {1, 2, 3};\nstd::cout << arr[1]; // يطبع 2", "كم تساوي arr[2]؟", "3", "3", "تأكد من أنك قمت بطباعة القيمة باستخدام std::cout."},
+    {"switch\nتحدد الكود الذي ينفذ حسب القيمة.", "int day = 2;\nswitch(day) {\n    case 1: std::cout << \"الاثنين\"; break;\n    case 2: std::cout << \"الثلاثاء\"; break;\n    default: std::cout << \"أخرى\";\n}", "ماذا يطبع إذا كان day = 2؟", "الثلاثاء", "الثلاثاء", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."},
+    {"أساسيات معالجة الأخطاء\nاستخدم try/catch لمعالجة الأخطاء.", "try {\n    throw std::runtime_error(\"خطأ!\");\n} catch (const std::exception& e) {\n    std::cout << e.what();\n}", "ماذا تطبع e.what()؟", "خطأ!", "خطأ!", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."}
+};
+
+constexpr Lesson kArabicAdvanced[] = {
+    {"الكائنات والبرمجة الكائنية\nالكائنات تجمع البيانات والدوال.", "class Person {\npublic:\n    std::string name;\n    void say_hello() {\n        std::cout << \"مرحباً، أنا \" << name << std::endl;\n    }\n};", "كيف تستدعي say_hello على كائن p؟", "p.say_hello();", "p.say_hello();", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."},
+    {"المؤشرات والذاكرة\nالمؤشرات تخزن عناوين المتغيرات.", "int x = 10;\nint* p = &x;\nstd::cout << *p; // يطبع 10", "ماذا يطبع *p؟", "10", "10", "تأكد من أنك قمت بطباعة القيمة باستخدام std::cout."},
+    {"التعامل مع الملفات\nاقرأ/اكتب الملفات باستخدام fstream.", "#include <fstream>\nstd::ofstream out(\"file.txt\");\nout << \"Hello\";\nout.close();", "أي ترويسة تحتاجها للتعامل مع الملفات؟", "<fstream>", "<fstream>", "تأكد من أنك قمت بإضافة #include <fstream>."},
+    {"مكتبة القوالب القياسية STL\nتوفر حاويات مفيدة.", "#include <vector>\nstd::vector<int> v = {1,2,3};\nv.push_back(4);", "كيف تضيف عنصراً إلى vector؟", "v.push_back(value);", "v.push_back(value);", "تأكد من أنك قمت بإضافة v.push_back(value);."},
+    {"مشروع صغير\nاستخدم ما تعلمته!\nاكتب برنامجاً يطلب 3 أرقام ويطبع مجموعها.", "#include <iostream>\nint main() {\n    int a, b, c;\n    std::cin >> a >> b >> c;\n    std::cout << (a + b + c);\n    return 0;\n}", "ماذا يفعل هذا البرنامج؟", "يقرأ 3 أرقام ويطبع مجموعها.", "يقرأ 3 أرقام ويطبع مجموعها.", "تأكد من أنك قمت بطباعة النتيجة باستخدام std::cout."}
+};
+
+constexpr BuiltinLevel kArabicLevels[] = {
+    {"مبتدئ 👶", kArabicBeginner, sizeof(kArabicBeginner) / sizeof(Lesson)},
+    {"متوسط 🧑‍💻", kArabicIntermediate, sizeof(kArabicIntermediate) / sizeof(Lesson)},
+    {"متقدم 👨‍🏫", kArabicAdvanced, sizeof(kArabicAdvanced) / sizeof(Lesson)},
+};
+
+constexpr BuiltinCatalog kArabicCatalog = {
     {
-        { // Beginner
-            "مبتدئ 👶",
-            {
-                {"ما البرمجة؟\nالبرمجة هي إعطاء أوامر للحاسوب لتنفيذ مهام.", "// لا يوجد كود لهذا المفهوم.", "ما هي البرمجة بكلماتك؟", "البرمجة هي إخبار الحاسوب بما يجب فعله باستخدام الكود.", "البرمجة هي إخبار الحاسوب بما يجب فعله باستخدام الكود.", "البرمجة هي إخبار الحاسوب بما يجب فعله باستخدام الكود."},
-                {"ما هي ++C؟\n++C لغة برمجة قوية لبناء البرامج والألعاب والمزيد.", "// لا يوجد كود لهذا المفهوم.", "اذكر شيئاً يمكن بناؤه بـ ++C.", "ألعاب، تطبيقات، أنظمة تشغيل، إلخ.", "ألعاب، تطبيقات، أنظمة تشغيل، إلخ.", "يمكنك بناء ألعاب، تطبيقات، أنظمة تشغيل."},
-                {"برنامج Hello World!\nأول برنامج يطبع رسالة.", "#include <iostream>\nint main() {\n    std::cout << \"Hello, World!\\n\";\n    return 0;\n}", "ماذا يطبع هذا البرنامج؟", "Hello, World!", "Hello, World!", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."},
-                {"الإدخال والإخراج\nيمكنك قراءة وطباعة القيم باستخدام std::cin و std::cout.", "#include <iostream>\nint main() {\n    int age;\n    std::cout << \"أدخل عمرك: \";\n    std::cin >> age;\n    std::cout << \"عمرك \" << age << \" سنة.\\n\";\n    return 0;\n}", "كيف تطبع قيمة في ++C؟", "باستخدام std::cout.", "باستخدام std::cout.", "تأكد من أنك قمت بطباعة القيمة باستخدام std::cout."},
-                {"المتغيرات والأنواع\nالمتغيرات تخزن البيانات. ++C بها أنواع مثل int, double, char.", "int x = 5;\ndouble y = 3.14;\nchar c = 'A';", "أي نوع تستخدمه للعدد العشري؟", "double", "double", "استخدم double للأرقام العشرية."},
-                {"if/else\nاستخدم if/else لاتخاذ قرارات.", "int x = 10;\nif (x > 5) {\n    std::cout << \"x أكبر من 5\\n\";\n} else {\n    std::cout << \"x أقل أو يساوي 5\\n\";\n}", "ماذا يطبع الكود إذا كان x = 3؟", "x أقل أو يساوي 5", "x أقل أو يساوي 5", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."}
-            }
-        },
-        { // Intermediate
-            "متوسط 🧑‍💻",
-            {
-                {"الحلقات\nالحلقات تكرر الأوامر. مثال: حلقة for.", "for (int i = 0; i < 5; ++i) { std::cout << i << \" \"; }", "كم مرة تعمل هذه الحلقة؟", "5 مرات (i = 0 إلى 4)", "5 مرات (i = 0 إلى 4)", "تأكد من أنك قمت بطباعة الرقم باستخدام std::cout."},
-                {"الدوال\nالدوال تجمع كوداً لتنفيذ مهمة.", "int add(int a, int b) {\n    return a + b;\n}\n// الاستخدام:\nint sum = add(2, 3);", "ماذا تعيد add(2, 3)؟", "5", "5", "تأكد من أنك قمت بإرجاع القيمة باستخدام return.", "الكائنات والبرمجة الكائنية", "متقدم 👨‍🏫"},
-                {"المصفوفات\nالمصفوفة تخزن عدة قيم من نفس النوع.", "int arr[3] = {1, 2, 3};\nstd::cout << arr[1]; // يطبع 2", "كم تساوي arr[2]؟", "3", "3", "تأكد من أنك قمت بطباعة القيمة باستخدام std::cout."},
-                {"switch\nتحدد الكود الذي ينفذ حسب القيمة.", "int day = 2;\nswitch(day) {\n    case 1: std::cout << \"الاثنين\"; break;\n    case 2: std::cout << \"الثلاثاء\"; break;\n    default: std::cout << \"أخرى\";\n}", "ماذا يطبع إذا كان day = 2؟", "الثلاثاء", "الثلاثاء", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."},
-                {"أساسيات معالجة الأخطاء\nاستخدم try/catch لمعالجة الأخطاء.", "try {\n    throw std::runtime_error(\"خطأ!\");\n} catch (const std::exception& e) {\n    std::cout << e.what();\n}", "ماذا تطبع e.what()؟", "خطأ!", "خطأ!", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."}
-            }
-        },
-        { // Advanced
-            "متقدم 👨‍🏫",
-            {
-                {"الكائنات والبرمجة الكائنية\nالكائنات تجمع البيانات والدوال.", "class Person {\npublic:\n    std::string name;\n    void say_hello() {\n        std::cout << \"مرحباً، أنا \" << name << std::endl;\n    }\n};", "كيف تستدعي say_hello على كائن p؟", "p.say_hello();", "p.say_hello();", "تأكد من أنك قمت بطباعة الرسالة باستخدام std::cout."},
-                {"المؤشرات والذاكرة\nالمؤشرات تخزن عناوين المتغيرات.", "int x = 10;\nint* p = &x;\nstd::cout << *p; // يطبع 10", "ماذا يطبع *p؟", "10", "10", "تأكد من أنك قمت بطباعة القيمة باستخدام std::cout."},
-                {"التعامل مع الملفات\nاقرأ/اكتب الملفات باستخدام fstream.", "#include <fstream>\nstd::ofstream out(\"file.txt\");\nout << \"Hello\";\nout.close();", "أي ترويسة تحتاجها للتعامل مع الملفات؟", "<fstream>", "<fstream>", "تأكد من أنك قمت بإضافة #include <fstream>."},
-                {"مكتبة القوالب القياسية STL\nتوفر حاويات مفيدة.", "#include <vector>\nstd::vector<int> v = {1,2,3};\nv.push_back(4);", "كيف تضيف عنصراً إلى vector؟", "v.push_back(value);", "v.push_back(value);", "تأكد من أنك قمت بإضافة v.push_back(value);."},
-                {"مشروع صغير\nاستخدم ما تعلمته!\nاكتب برنامجاً يطلب 3 أرقام ويطبع مجموعها.", "#include <iostream>\nint main() {\n    int a, b, c;\n    std::cin >> a >> b >> c;\n    std::cout << (a + b + c);\n    return 0;\n}", "ماذا يفعل هذا البرنامج؟", "يقرأ 3 أرقام ويطبع مجموعها.", "يقرأ 3 أرقام ويطبع مجموعها.", "تأكد من أنك قمت بطباعة النتيجة باستخدام std::cout."}
+        // UI Strings
+        "اختر اللغة / Select language:\n1) English\n2) العربية",
+        "اختر مستواك الحالي:\n1) مبتدئ 👶\n2) متوسط 🧑‍💻\n3) متقدم 👨‍🏫",
+        "مبتدئ",
+        "متوسط",
+        "متقدم",
+        "اكتب أمر (التالي، السابق، إعادة، الكود، الحل، خروج، ملاحظة، ملاحظات، علامة، اذهب، وضع، بحث، المستحق، تشغيل): ",
+        "أمر غير صالح. حاول مرة أخرى.",
+        "\n--- الدرس ",
+        "\nمثال الكود:",
+        "\nتحدي صغير:",
+        "\nالحل:",
+        "وداعاً! تعلم سعيد!",
+        "[الأوامر: التالي، السابق، إعادة، الكود، الحل، خروج، ملاحظة، ملاحظات، علامة، اذهب، وضع، بحث، المستحق، تشغيل]",
+        "أنت في أول درس.",
+        "أنت في آخر درس.",
+        // New UI strings for features
+        "💡 موضوع ذو صلة: ",
+        "أدخل ملاحظتك لهذا الدرس: ",
+        "✅ تم حفظ الملاحظة بنجاح!",
+        "\n📝 ملاحظاتك:",
+        "لا توجد ملاحظات.",
+        "⏰ مر {days} أيام منذ جلستك الأخيرة. مستعد للمتابعة؟",
+        "👨‍🏫 وضع المحاضر",
+        "أدخل كلمة مرور المحاضر: ",
+        "🔖 تم حفظ العلامة في الدرس ",
+        "🔖 انتقل إلى الدرس المحدد ",
+        "📊 ملخص الإحصائيات الأسبوعية",
+        "🔁 تم إنشاء نسخة احتياطية بنجاح!",
+        // Welcome message for typing animation
+        "أهلاً! أنا أستاذك الخاص في تعلم البرمجة.\nسأرشدك في تعلم ++C بلغتك المفضلة!\nتم تطويري بحب بواسطة مطورك عثمان محمد. هيا نبدأ! 💻🚀",
+        // Rewards and search
+        "✅ لقد حصلت على 10 نقطة خبرة! المجموع: ",
+        "✅ أنجزت {done}/{goal} من هدفك اليومي!",
+        "🎉 لقد حققت هدفك اليومي! أنت رائع!",
+        "❌ لا توجد علامة محفوظة!",
+        "ابحث عن: ",
+        "🔍 لا توجد دروس مطابقة لبحثك.",
+        "أدخل رقم النتيجة لفتحها، أو اضغط Enter للرجوع: ",
+    },
+    kArabicLevels,
+    sizeof(kArabicLevels) / sizeof(BuiltinLevel)
+};
+static_assert(!kArabicCatalog.ui[kUiStringCount - 1].empty(), "one UI string per kUiStrings entry");
+
+// --- Lesson Packs ---
+// A lesson pack is a versioned binary image of one Localization. It is
+// mmap()ed and read in place through string_views, so opening a pack costs
+// the same no matter how many lessons it holds and only touched pages are
+// faulted in. The built-in catalogs above remain the fallback pack.
+//
+// Layout (little-endian, offsets from the start of the file, 8-byte aligned):
+//   PackHeader
+//   PackString[ui_count]      UI strings, in kUiStrings order
+//   PackLevel[level_count]    level name + range into the lesson index
+//   PackLesson[lesson_count]  one PackString per Lesson field
+//   string table              deduplicated UTF-8 bytes
+const char kPackMagic[8] = {'L', 'R', 'N', 'P', 'A', 'C', 'K', '\0'};
+const uint32_t kPackVersion = 1;
+// Pack structs are written and mapped as they are in memory, with no byte swapping
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "lesson packs are little-endian; this host is not");
+
+struct PackString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct PackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    char language[8];
+    uint32_t ui_count;
+    uint32_t level_count;
+    uint32_t lesson_count;
+    uint32_t reserved;
+    uint64_t ui_offset;
+    uint64_t level_offset;
+    uint64_t lesson_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct PackLevel {
+    PackString name;
+    uint32_t first_lesson;
+    uint32_t lesson_count;
+};
+
+const int kLessonFieldCount = 8;
+
+struct PackLesson {
+    PackString fields[kLessonFieldCount];
+};
+
+// Read-only view of one lesson, backed by a pack or by a built-in Lesson
+struct LessonView {
+    std::string_view explanation;
+    std::string_view code;
+    std::string_view challenge;
+    std::string_view solution;
+    std::string_view expected_output;
+    std::string_view hint;
+    std::string_view related_title;
+    std::string_view related_level;
+};
+
+// Field order shared by the pack format, Lesson and LessonView
+InternedText Lesson::* const kLessonFields[kLessonFieldCount] = {
+    &Lesson::explanation, &Lesson::code, &Lesson::challenge, &Lesson::solution,
+    &Lesson::expected_output, &Lesson::hint, &Lesson::related_title, &Lesson::related_level
+};
+
+std::string_view LessonView::* const kLessonViewFields[kLessonFieldCount] = {
+    &LessonView::explanation, &LessonView::code, &LessonView::challenge, &LessonView::solution,
+    &LessonView::expected_output, &LessonView::hint, &LessonView::related_title, &LessonView::related_level
+};
+
+const char* const kLessonFieldNames[kLessonFieldCount] = {
+    "Explanation", "Code", "Challenge", "Solution", "Expected output", "Hint", "Related title", "Related level"
+};
+
+// Read-only file mapping
+class MappedFile {
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) { ::close(fd); return false; }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        data_ = static_cast<const char*>(p);
+        size_ = (size_t)st.st_size;
+        return true;
+    }
+
+    void close() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+class LessonPack {
+public:
+    // Validates the header and index bounds only; lesson data is never touched here
+    bool open(const std::string& path, std::string* error) {
+        if (!file_.open(path)) { if (error) *error = "cannot open " + path; return false; }
+        const char* base = file_.data();
+        size_t size = file_.size();
+        if (size < sizeof(PackHeader)) return fail(error, "truncated header");
+        header_ = reinterpret_cast<const PackHeader*>(base);
+        if (std::memcmp(header_->magic, kPackMagic, sizeof(kPackMagic)) != 0) return fail(error, "bad magic");
+        if (header_->version != kPackVersion) return fail(error, "unsupported version " + std::to_string(header_->version));
+        if (!in_bounds(header_->ui_offset, (uint64_t)header_->ui_count * sizeof(PackString)) ||
+            !in_bounds(header_->level_offset, (uint64_t)header_->level_count * sizeof(PackLevel)) ||
+            !in_bounds(header_->lesson_offset, (uint64_t)header_->lesson_count * sizeof(PackLesson)) ||
+            !in_bounds(header_->strings_offset, header_->strings_size)) {
+            return fail(error, "index out of bounds");
+        }
+        ui_ = reinterpret_cast<const PackString*>(base + header_->ui_offset);
+        levels_ = reinterpret_cast<const PackLevel*>(base + header_->level_offset);
+        lessons_ = reinterpret_cast<const PackLesson*>(base + header_->lesson_offset);
+        strings_ = base + header_->strings_offset;
+        for (uint32_t i = 0; i < header_->level_count; ++i) {
+            if ((uint64_t)levels_[i].first_lesson + levels_[i].lesson_count > header_->lesson_count) {
+                return fail(error, "level " + std::to_string(i) + " out of bounds");
             }
         }
+        return true;
+    }
+
+    std::string language() const {
+        return std::string(header_->language, strnlen(header_->language, sizeof(header_->language)));
+    }
+    uint32_t ui_count() const { return header_->ui_count; }
+    uint32_t level_count() const { return header_->level_count; }
+    uint32_t lesson_count(uint32_t level) const { return levels_[level].lesson_count; }
+    std::string_view ui_string(uint32_t i) const { return str(ui_[i]); }
+    std::string_view level_name(uint32_t level) const { return str(levels_[level].name); }
+
+    LessonView lesson(uint32_t level, uint32_t lesson) const {
+        const PackLesson& rec = lessons_[levels_[level].first_lesson + lesson];
+        LessonView view;
+        for (int f = 0; f < kLessonFieldCount; ++f) view.*kLessonViewFields[f] = str(rec.fields[f]);
+        return view;
+    }
+
+private:
+    bool fail(std::string* error, const std::string& why) {
+        if (error) *error = why;
+        file_.close();
+        header_ = nullptr;
+        return false;
     }
+    bool in_bounds(uint64_t offset, uint64_t length) const {
+        return offset <= file_.size() && length <= file_.size() - offset;
+    }
+    // Corrupt string references read as empty rather than past the mapping
+    std::string_view str(PackString s) const {
+        if ((uint64_t)s.offset + s.length > header_->strings_size) return std::string_view();
+        return std::string_view(strings_ + s.offset, s.length);
+    }
+
+    MappedFile file_;
+    const PackHeader* header_ = nullptr;
+    const PackString* ui_ = nullptr;
+    const PackLevel* levels_ = nullptr;
+    const PackLesson* lessons_ = nullptr;
+    const char* strings_ = nullptr;
 };
 
-// --- Helper Functions ---
-void clear_screen() {
-#ifdef _WIN32
-    system("cls");
-#else
-    system("clear");
-#endif
+// --- Catalog Access ---
+// Lessons are read through these helpers so that pack-backed and built-in
+// catalogs look the same to the lesson loop. A pack-backed or built-in
+// Localization keeps one empty Level per level of its source; a level is
+// copied into memory only when it is modified (import, instructor edit).
+int level_count(const Localization& loc) {
+    return (int)loc.levels.size();
 }
 
-void print_centered(const std::string& text) {
-    // Simple print, can be improved for true centering
-    std::cout << text << std::endl;
+bool reads_from_pack(const Localization& loc, int level) {
+    return loc.pack && level < (int)loc.pack->level_count() && loc.levels[level].lessons.empty();
 }
 
-// Typing animation utility function
-void type_text(const std::string& text, int delay_ms = 25) {
-    for (char c : text) {
-        std::cout << c << std::flush;
-        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+bool reads_from_builtin(const Localization& loc, int level) {
+    return loc.builtin && level < (int)loc.builtin->level_count && loc.levels[level].lessons.empty();
+}
+
+int level_lesson_count(const Localization& loc, int level) {
+    if (reads_from_pack(loc, level)) return (int)loc.pack->lesson_count(level);
+    if (reads_from_builtin(loc, level)) return (int)loc.builtin->levels[level].lesson_count;
+    return (int)loc.levels[level].lessons.size();
+}
+
+LessonView lesson_view(const Localization& loc, int level, int lesson) {
+    LessonView view;
+    if (reads_from_pack(loc, level)) {
+        view = loc.pack->lesson(level, lesson);
+    } else {
+        const Lesson& l = reads_from_builtin(loc, level) ? loc.builtin->levels[level].lessons[lesson] : loc.levels[level].lessons[lesson];
+        for (int f = 0; f < kLessonFieldCount; ++f) view.*kLessonViewFields[f] = l.*kLessonFields[f];
+    }
+    if (!loc.patches.empty()) {
+        auto it = loc.patches.find(patch_key(level, lesson));
+        if (it != loc.patches.end()) {
+            for (int f = 0; f < kLessonFieldCount; ++f) {
+                if (it->second.mask & (1u << f)) view.*kLessonViewFields[f] = it->second.fields[f];
+            }
+        }
     }
-    std::cout << std::endl;
+    return view;
 }
 
-// Helper to get current date as string (YYYY-MM-DD)
-std::string get_current_date() {
-    time_t t = time(nullptr);
-    tm* now = localtime(&t);
-    char buf[11];
-    snprintf(buf, sizeof(buf), "%04d-%02d-%02d", now->tm_year + 1900, now->tm_mon + 1, now->tm_mday);
-    return std::string(buf);
+// Copy-on-write: materialize a pack or built-in level before it is changed
+Level& editable_level(Localization& loc, int level) {
+    Level& lvl = loc.levels[level];
+    if (reads_from_builtin(loc, level)) {
+        const BuiltinLevel& source = loc.builtin->levels[level];
+        lvl.lessons.assign(source.lessons, source.lessons + source.lesson_count);
+    }
+    if (reads_from_pack(loc, level)) {
+        uint32_t count = loc.pack->lesson_count(level);
+        lvl.lessons.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            LessonView view = loc.pack->lesson(level, i);
+            Lesson l;
+            for (int f = 0; f < kLessonFieldCount; ++f) l.*kLessonFields[f] = InternedText::intern(view.*kLessonViewFields[f]);
+            lvl.lessons.push_back(std::move(l));
+        }
+    }
+    return lvl;
 }
 
-// Helper to get current week number (ISO week)
-int get_week_number() {
-    time_t t = time(nullptr);
-    tm* now = localtime(&t);
-    char buf[5];
-    strftime(buf, sizeof(buf), "%W", now);
-    return atoi(buf);
+// A built-in catalog as a Localization; lessons stay in the catalog's tables
+std::unique_ptr<Localization> open_builtin_localization(const BuiltinCatalog& catalog) {
+    std::unique_ptr<Localization> loc(new Localization());
+    for (uint32_t i = 0; i < kUiStringCount; ++i) loc.get()->*kUiStrings[i] = std::string(catalog.ui[i]);
+    loc->levels.resize(catalog.level_count);
+    for (size_t i = 0; i < catalog.level_count; ++i) loc->levels[i].name = std::string(catalog.levels[i].name);
+    loc->builtin = &catalog;
+    return loc;
 }
 
-// Helper to get days between two dates (YYYY-MM-DD)
-int days_between(const std::string& d1, const std::string& d2) {
-    std::tm tm1 = {}, tm2 = {};
-    int year1, month1, day1, year2, month2, day2;
-    sscanf(d1.c_str(), "%d-%d-%d", &year1, &month1, &day1);
-    sscanf(d2.c_str(), "%d-%d-%d", &year2, &month2, &day2);
-    tm1.tm_year = year1 - 1900;
-    tm1.tm_mon = month1 - 1;
-    tm1.tm_mday = day1;
-    tm2.tm_year = year2 - 1900;
-    tm2.tm_mon = month2 - 1;
-    tm2.tm_mday = day2;
-    time_t t1 = mktime(&tm1);
-    time_t t2 = mktime(&tm2);
-    return (int)std::difftime(t2, t1) / (60 * 60 * 24);
+// Open a pack as a Localization; UI strings missing from the pack come from fallback
+std::unique_ptr<Localization> open_localization_pack(const std::string& path, const BuiltinCatalog& fallback, std::string* error) {
+    std::shared_ptr<LessonPack> pack = std::make_shared<LessonPack>();
+    if (!pack->open(path, error)) return nullptr;
+    std::unique_ptr<Localization> loc(new Localization());
+    for (uint32_t i = 0; i < kUiStringCount; ++i) {
+        loc.get()->*kUiStrings[i] = std::string(i < pack->ui_count() ? pack->ui_string(i) : fallback.ui[i]);
+    }
+    loc->levels.resize(pack->level_count());
+    for (uint32_t i = 0; i < pack->level_count(); ++i) loc->levels[i].name = std::string(pack->level_name(i));
+    loc->pack = pack;
+    return loc;
 }
 
-// Progress save/load helpers
-void save_progress(int lang, int level, int lesson, int xp, int bookmark, int daily_goal, int daily_progress, const std::string& last_goal_date, int total_lessons_completed, int total_xp, int sessions_count, const std::string& last_seen_date, int session_counter, int weekly_lessons, int weekly_xp, int weekly_sessions, int current_week) {
-    std::ofstream out("progress.txt");
-    if (out) {
-        out << lang << ' ' << level << ' ' << lesson << ' ' << xp << ' ' << bookmark << ' ' << daily_goal << ' ' << daily_progress << ' ' << last_goal_date << ' ' << total_lessons_completed << ' ' << total_xp << ' ' << sessions_count << ' ' << last_seen_date << ' ' << session_counter << ' ' << weekly_lessons << ' ' << weekly_xp << ' ' << weekly_sessions << ' ' << current_week << std::endl;
+// Serialize a catalog (built-in or pack-backed, including in-memory edits) to a pack
+bool write_lesson_pack(const Localization& loc, const std::string& language, const std::string& path) {
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> offsets;
+    auto intern = [&](std::string_view s) {
+        PackString ref;
+        ref.length = (uint32_t)s.size();
+        auto it = offsets.find(std::string(s));
+        if (it != offsets.end()) { ref.offset = it->second; return ref; }
+        ref.offset = (uint32_t)strings.size();
+        offsets.emplace(std::string(s), ref.offset);
+        strings.append(s.data(), s.size());
+        return ref;
+    };
+
+    std::vector<PackString> ui;
+    for (uint32_t i = 0; i < kUiStringCount; ++i) ui.push_back(intern(loc.*kUiStrings[i]));
+    std::vector<PackLevel> levels;
+    std::vector<PackLesson> lessons;
+    for (int lv = 0; lv < level_count(loc); ++lv) {
+        PackLevel rec;
+        rec.name = intern(loc.levels[lv].name);
+        rec.first_lesson = (uint32_t)lessons.size();
+        rec.lesson_count = (uint32_t)level_lesson_count(loc, lv);
+        for (uint32_t i = 0; i < rec.lesson_count; ++i) {
+            LessonView view = lesson_view(loc, lv, (int)i);
+            PackLesson l;
+            for (int f = 0; f < kLessonFieldCount; ++f) l.fields[f] = intern(view.*kLessonViewFields[f]);
+            lessons.push_back(l);
+        }
+        levels.push_back(rec);
     }
+
+    auto align8 = [](uint64_t n) { return (n + 7) & ~(uint64_t)7; };
+    PackHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, kPackMagic, sizeof(kPackMagic));
+    h.version = kPackVersion;
+    h.header_size = sizeof(PackHeader);
+    std::strncpy(h.language, language.c_str(), sizeof(h.language) - 1);
+    h.ui_count = (uint32_t)ui.size();
+    h.level_count = (uint32_t)levels.size();
+    h.lesson_count = (uint32_t)lessons.size();
+    h.ui_offset = align8(sizeof(PackHeader));
+    h.level_offset = align8(h.ui_offset + ui.size() * sizeof(PackString));
+    h.lesson_offset = align8(h.level_offset + levels.size() * sizeof(PackLevel));
+    h.strings_offset = align8(h.lesson_offset + lessons.size() * sizeof(PackLesson));
+    h.strings_size = strings.size();
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    auto write_at = [&](uint64_t offset, const void* data, size_t n) {
+        while ((uint64_t)out.tellp() < offset) out.put('\0');
+        out.write(static_cast<const char*>(data), n);
+    };
+    write_at(0, &h, sizeof(h));
+    write_at(h.ui_offset, ui.data(), ui.size() * sizeof(PackString));
+    write_at(h.level_offset, levels.data(), levels.size() * sizeof(PackLevel));
+    write_at(h.lesson_offset, lessons.data(), lessons.size() * sizeof(PackLesson));
+    write_at(h.strings_offset, strings.data(), strings.size());
+    out.close();
+    if (!out) { std::remove(tmp.c_str()); return false; }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
 }
 
-bool load_progress(int &lang, int &level, int &lesson, int &xp, int &bookmark, int &daily_goal, int &daily_progress, std::string& last_goal_date, int &total_lessons_completed, int &total_xp, int &sessions_count, std::string& last_seen_date, int &session_counter, int &weekly_lessons, int &weekly_xp, int &weekly_sessions, int &current_week) {
-    std::ifstream in("progress.txt");
-    if (in) {
-        in >> lang >> level >> lesson >> xp >> bookmark >> daily_goal >> daily_progress >> last_goal_date >> total_lessons_completed >> total_xp >> sessions_count >> last_seen_date >> session_counter >> weekly_lessons >> weekly_xp >> weekly_sessions >> current_week;
-        return true;
+// Directory searched for lessons_<lang>.pack files (--pack-dir)
+std::string g_pack_dir = ".";
+
+// --- Locale Registry ---
+// The languages this build offers. Listing them loads nothing: a language's
+// catalog (lessons_<code>.pack, else its built-in content) is built the
+// first time a session selects it (current_catalog), so a process only ever
+// holds the languages in use. The id is what progress, events, reviews and
+// the overlay record, in one byte; an entry keeps its id for good and new
+// languages are appended. The language menu, pack names, --export-pack and
+// --import-dir all come from this table.
+struct LocaleInfo {
+    int id;
+    const char* code;           // lessons_<code>.pack, --export-pack <code>
+    const char* name;           // in the language menu, in its own script
+    const BuiltinCatalog* builtin;  // built-in content, also the pack fallback
+};
+
+const LocaleInfo kLocales[] = {
+    {1, "en", "English", &kEnglishCatalog},
+    {2, "ar", "العربية", &kArabicCatalog},
+};
+const size_t kLocaleCount = sizeof(kLocales) / sizeof(kLocales[0]);
+static_assert(kLocaleCount < 32, "catalog reloads track languages in an unsigned mask");
+const char kLanguageMenuTitle[] = "Select language / اختر اللغة:";
+
+// Position of a language in kLocales; -1 if there is no such language
+int locale_index(int id) {
+    for (size_t i = 0; i < kLocaleCount; ++i) {
+        if (kLocales[i].id == id) return (int)i;
     }
-    return false;
+    return -1;
 }
 
-void delete_progress() {
-    std::remove("progress.txt");
+const LocaleInfo* find_locale(int id) {
+    int i = locale_index(id);
+    return i < 0 ? nullptr : &kLocales[i];
 }
 
-// Notes system helpers
-void save_note(int lang, int level, int lesson, const std::string& note) {
-    std::ofstream out("notes.txt", std::ios::app);
-    if (out) {
-        out << get_current_date() << " | Lang:" << lang << " | Level:" << level << " | Lesson:" << (lesson + 1) << " | " << note << std::endl;
+const LocaleInfo* find_locale_code(std::string_view code) {
+    for (const LocaleInfo& info : kLocales) {
+        if (code == info.code) return &info;
     }
+    return nullptr;
 }
 
-void display_notes() {
-    std::ifstream in("notes.txt");
-    if (!in) {
-        type_text("No notes found.", 20);
-        return;
-    }
-    std::string line;
-    type_text("\n📝 Your Notes:", 25);
-    type_text("================", 10);
-    while (std::getline(in, line)) {
-        std::cout << line << std::endl;
+std::string locale_code(int id) {
+    const LocaleInfo* info = find_locale(id);
+    return info ? info->code : "lang" + std::to_string(id);
+}
+
+// "en|ar", for usage and error messages
+std::string locale_codes() {
+    std::string codes;
+    for (const LocaleInfo& info : kLocales) codes += (codes.empty() ? "" : "|") + std::string(info.code);
+    return codes;
+}
+
+std::string language_menu() {
+    std::string menu = kLanguageMenuTitle;
+    for (size_t i = 0; i < kLocaleCount; ++i) menu += "\n" + std::to_string(i + 1) + ") " + kLocales[i].name;
+    return menu;
+}
+
+// Language id for a menu answer; 0 if it names none
+int language_choice(const std::string& input) {
+    if (input.empty() || input.size() > 3 || input.find_first_not_of("0123456789") != std::string::npos) return 0;
+    size_t n = (size_t)std::stoi(input);
+    return (n >= 1 && n <= kLocaleCount) ? kLocales[n - 1].id : 0;
+}
+
+// --- Answer Matching ---
+// Challenge and quiz answers are compared after normalization: Unicode case
+// folding, Arabic diacritics/tatweel removed and alef/ya/hamza forms unified,
+// Arabic digits and punctuation mapped to ASCII, whitespace collapsed and
+// dropped around punctuation, trailing sentence punctuation ignored.
+// Each solution is normalized once into an AnswerKey; answers are compared
+// against it with a bit-parallel (Myers/Hyyro) edit distance, so small typos
+// are accepted up to g_match.tolerance_percent of the solution length.
+// Numbers are whole tokens, not letters: the answer's digit runs must equal
+// the solution's, so "6 times" never passes for "5 times" as a typo.
+struct MatchSettings {
+    int tolerance_percent = 15;  // --fuzzy; 0 = exact (normalized) matches only
+};
+
+MatchSettings g_match;
+
+// Decode one code point; invalid bytes map to U+DC80..U+DCFF so they still compare
+char32_t decode_utf8(const char*& p, const char* end) {
+    unsigned char c = (unsigned char)*p++;
+    int extra = (c >= 0xF0 && c < 0xF8) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC2 && c < 0xE0) ? 1 : 0;
+    if (c < 0x80) return c;
+    if (extra == 0 || end - p < extra) return 0xDC00 + c;
+    char32_t cp = c & (0x3F >> extra);
+    for (int i = 0; i < extra; ++i) {
+        unsigned char cc = (unsigned char)p[i];
+        if ((cc & 0xC0) != 0x80) return 0xDC00 + c;
+        cp = (cp << 6) | (cc & 0x3F);
     }
-    type_text("================", 10);
+    p += extra;
+    return cp;
 }
 
-// Automatic backup helper
-void create_backup() {
-    std::ifstream src("progress.txt");
-    std::ofstream dst("progress_backup.txt");
-    if (src && dst) {
-        dst << src.rdbuf();
+// Simple case folding for Latin, Greek and Cyrillic; Arabic letter unification.
+// Returns 0 for code points that are dropped entirely.
+char32_t fold_code_point(char32_t c) {
+    if (c < 0x80) return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 32;
+    if (c >= 0x100 && c <= 0x17F) {
+        if (c == 0x178) return 0xFF;
+        bool odd_upper = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149 || c == 0x17F) return c;
+        return ((c & 1) != 0) == odd_upper ? c + 1 : c;
     }
+    if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) return c + 32;
+    if (c == 0x3C2) return 0x3C3;  // final sigma
+    if (c >= 0x410 && c <= 0x42F) return c + 32;
+    if (c >= 0x400 && c <= 0x40F) return c + 80;
+    // Arabic: harakat, superscript alef and tatweel carry no meaning for grading
+    if ((c >= 0x64B && c <= 0x65F) || c == 0x670 || c == 0x640) return 0;
+    if (c == 0x622 || c == 0x623 || c == 0x625 || c == 0x671) return 0x627;  // alef forms
+    if (c == 0x649 || c == 0x626) return 0x64A;                               // alef maqsura, ya with hamza
+    if (c == 0x624) return 0x648;                                              // waw with hamza
+    if (c == 0x629) return 0x647;                                              // ta marbuta
+    if (c >= 0x660 && c <= 0x669) return '0' + (c - 0x660);
+    if (c >= 0x6F0 && c <= 0x6F9) return '0' + (c - 0x6F0);
+    if (c == 0x60C) return ',';
+    if (c == 0x61B) return ';';
+    if (c == 0x61F) return '?';
+    if (c == 0x66A) return '%';
+    if (c == 0x2018 || c == 0x2019) return '\'';
+    if (c == 0x201C || c == 0x201D) return '"';
+    if (c == 0xA0 || c == 0x2009 || c == 0x202F || c == 0x3000) return ' ';
+    if (c == 0x200B || c == 0x200C || c == 0x200D || c == 0xFEFF || c == 0x200F || c == 0x200E) return 0;
+    return c;
 }
 
-// Weekly statistics helper
-void display_weekly_stats(int weekly_lessons, int weekly_xp, int weekly_sessions) {
-    type_text("\033[1;36m📊 Weekly Statistics Summary\033[0m", 25);
-    type_text("================", 10);
-    type_text("✅ Total Lessons Completed: " + std::to_string(weekly_lessons), 20);
-    type_text("🎯 Total XP: " + std::to_string(weekly_xp), 20);
-    type_text("📅 Number of Sessions: " + std::to_string(weekly_sessions), 20);
-    if (weekly_sessions > 0) {
-        double avg_lessons = (double)weekly_lessons / weekly_sessions;
-        std::stringstream ss;
-        ss << std::fixed << std::setprecision(1) << avg_lessons;
-        type_text("📈 Average Lessons Per Session: " + ss.str(), 20);
+bool is_match_space(char32_t c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+bool is_match_punct(char32_t c) { return c < 0x80 && std::ispunct((int)c); }
+
+// The digit runs of normalized text, each ended by a space
+void number_tokens(const std::u32string& text, std::u32string& out) {
+    out.clear();
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] < '0' || text[i] > '9') continue;
+        out.push_back(text[i]);
+        if (i + 1 == text.size() || text[i + 1] < '0' || text[i + 1] > '9') out.push_back(' ');
     }
-    type_text("================", 10);
 }
 
-// Instructor mode helper
-bool instructor_mode_edit(Localization* loc, int level, int lesson) {
-    type_text("\033[1;33m" + loc->instructor_mode + "\033[0m", 25);
-    std::cout << loc->instructor_password;
-    std::string password;
-    std::getline(std::cin, password);
-    
-    if (password != "instructor123") {
-        type_text("\033[31m❌ Incorrect password!\033[0m", 20);
-        return false;
+// Normalize into out (cleared first); out's capacity is reused between calls
+void normalize_answer(std::string_view text, std::u32string& out) {
+    out.clear();
+    const char* p = text.data();
+    const char* end = p + text.size();
+    bool pending_space = false;
+    while (p < end) {
+        char32_t c = fold_code_point(decode_utf8(p, end));
+        if (c == 0) continue;
+        if (is_match_space(c)) { pending_space = !out.empty(); continue; }
+        if (pending_space && !is_match_punct(c) && !is_match_punct(out.back())) out.push_back(' ');
+        pending_space = false;
+        out.push_back(c);
+    }
+    while (!out.empty() && (out.back() == '.' || out.back() == ';' || out.back() == '!' || out.back() == '?' || out.back() == ',')) {
+        out.pop_back();
     }
-    
-    type_text("\033[32m✅ Access granted!\033[0m", 20);
-    type_text("What would you like to edit?", 20);
-    type_text("1) Explanation", 15);
-    type_text("2) Code", 15);
-    type_text("3) Challenge", 15);
-    type_text("4) Solution", 15);
-    type_text("5) Cancel", 15);
-    std::string choice;
-    std::getline(std::cin, choice);
-    
-    if (choice == "5") return false;
-    
-    type_text("Enter new content:", 20);
-    std::string new_content;
-    std::getline(std::cin, new_content);
-    
-    if (choice == "1") loc->levels[level].lessons[lesson].explanation = new_content;
-    else if (choice == "2") loc->levels[level].lessons[lesson].code = new_content;
-    else if (choice == "3") loc->levels[level].lessons[lesson].challenge = new_content;
-    else if (choice == "4") loc->levels[level].lessons[lesson].solution = new_content;
-    
-    type_text("\033[32m✅ Content updated!\033[0m", 20);
-    return true;
 }
 
-// Smart reminder helper
-void show_reminder(const std::string& last_seen_date, Localization* loc) {
-    std::string today = get_current_date();
-    int days = days_between(last_seen_date, today);
-    if (days > 2) {
-        std::string message = loc->reminder_message;
-        size_t pos = message.find("{days}");
-        if (pos != std::string::npos) {
-            message.replace(pos, 6, std::to_string(days));
+// A precompiled solution: normalized text plus the Myers match vectors
+class AnswerKey {
+public:
+    AnswerKey() {}
+
+    explicit AnswerKey(std::string_view solution) {
+        normalize_answer(solution, pattern_);
+        number_tokens(pattern_, numbers_);
+        std::memset(ascii_peq_, 0, sizeof(ascii_peq_));
+        if (pattern_.size() > 64) return;
+        for (size_t i = 0; i < pattern_.size(); ++i) {
+            char32_t c = pattern_[i];
+            uint64_t bit = 1ull << i;
+            if (c < 128) { ascii_peq_[c] |= bit; continue; }
+            auto it = std::lower_bound(other_peq_.begin(), other_peq_.end(), c,
+                                       [](const std::pair<char32_t, uint64_t>& e, char32_t v) { return e.first < v; });
+            if (it != other_peq_.end() && it->first == c) it->second |= bit;
+            else other_peq_.insert(it, {c, bit});
         }
-        std::cout << "\033[1;33m" << message << "\033[0m\n";
-        std::cout << "Press Enter to continue...";
-        std::cin.get();
     }
-}
 
-// Helper to run end-of-level quiz
-void run_end_of_level_quiz(const Level& level, int& xp, int& total_xp) {
-    clear_screen();
-    type_text("\033[1;36m===== End-of-Level Quiz =====\033[0m", 25);
-    int num_questions = std::min(5, (int)level.lessons.size());
-    int correct = 0;
-    for (int i = 0; i < num_questions; ++i) {
-        type_text("Q" + std::to_string(i+1) + ": " + level.lessons[i].challenge, 20);
-        std::cout << "Your answer: ";
-        std::string answer;
-        std::getline(std::cin, answer);
-        auto trim = [](std::string s) { size_t f = s.find_first_not_of(" \t\n\r"); size_t l = s.find_last_not_of(" \t\n\r"); return (f == std::string::npos) ? "" : s.substr(f, l - f + 1); };
-        auto lower = [](std::string s) { for (auto& c : s) c = tolower(c); return s; };
-        std::string correct_ans = level.lessons[i].solution;
-        if (lower(trim(answer)) == lower(trim(correct_ans))) {
-            type_text("\033[32mCorrect!\033[0m", 15);
-            ++correct;
-            xp += 5;
-            total_xp += 5;
-        } else {
-            type_text("\033[31mIncorrect.\033[0m Solution: " + correct_ans, 20);
+    // True if answer matches within tolerance; distance receives the edit count
+    bool accepts(std::string_view answer, int* distance = nullptr) const {
+        thread_local std::u32string normalized, numbers;
+        normalize_answer(answer, normalized);
+        int allowed = (int)(pattern_.size() * g_match.tolerance_percent / 100);
+        number_tokens(normalized, numbers);
+        if (numbers != numbers_) {
+            // A different number is a wrong answer however close the text is
+            if (distance) *distance = allowed + 1;
+            return false;
+        }
+        int d = edit_distance(normalized, allowed);
+        if (distance) *distance = d;
+        return d <= allowed;
+    }
+
+private:
+    uint64_t peq(char32_t c) const {
+        if (c < 128) return ascii_peq_[c];
+        auto it = std::lower_bound(other_peq_.begin(), other_peq_.end(), c,
+                                   [](const std::pair<char32_t, uint64_t>& e, char32_t v) { return e.first < v; });
+        return (it != other_peq_.end() && it->first == c) ? it->second : 0;
+    }
+
+    // Levenshtein distance to text; anything above limit may be reported as limit + 1
+    int edit_distance(const std::u32string& text, int limit) const {
+        size_t m = pattern_.size();
+        size_t n = text.size();
+        if ((size_t)std::abs((long)m - (long)n) > (size_t)limit) return limit + 1;
+        if (m == 0) return (int)n;
+        if (text == pattern_) return 0;
+        if (limit == 0) return 1;
+        if (m > 64) return long_edit_distance(text);
+        uint64_t pv = (m == 64) ? ~0ull : ((1ull << m) - 1);
+        uint64_t mv = 0;
+        uint64_t last = 1ull << (m - 1);
+        int score = (int)m;
+        for (char32_t c : text) {
+            uint64_t eq = peq(c);
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & last) ++score;
+            else if (mh & last) --score;
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return score;
+    }
+
+    // Solutions longer than one machine word fall back to the row-by-row table
+    int long_edit_distance(const std::u32string& text) const {
+        thread_local std::vector<int> row;
+        row.resize(pattern_.size() + 1);
+        for (size_t i = 0; i <= pattern_.size(); ++i) row[i] = (int)i;
+        for (size_t j = 1; j <= text.size(); ++j) {
+            int diag = row[0];
+            row[0] = (int)j;
+            for (size_t i = 1; i <= pattern_.size(); ++i) {
+                int up = row[i];
+                row[i] = std::min({row[i] + 1, row[i - 1] + 1, diag + (pattern_[i - 1] == text[j - 1] ? 0 : 1)});
+                diag = up;
+            }
         }
+        return row[pattern_.size()];
     }
-    type_text("\n\033[1;36mFinal Score: " + std::to_string(correct) + "/" + std::to_string(num_questions) + "\033[0m", 25);
-    if (correct == num_questions) type_text("\033[32mGreat job!\033[0m", 20);
-    else if (correct >= num_questions/2) type_text("\033[33mGood effort!\033[0m", 20);
-    else type_text("\033[31mKeep practicing!\033[0m", 20);
-    std::cout << "\nType retry to retake the quiz, or press Enter to continue: ";
-    std::string retry;
-    std::getline(std::cin, retry);
-    if (retry == "retry") run_end_of_level_quiz(level, xp, total_xp);
+
+    std::u32string pattern_;
+    std::u32string numbers_;  // number_tokens(pattern_)
+    uint64_t ascii_peq_[128];
+    std::vector<std::pair<char32_t, uint64_t>> other_peq_;
+};
+
+// Compiled keys per catalog, built with the catalog and rebuilt for a level
+// after it is extended. g_derived_mutex guards the map itself (catalogs are
+// published and retired while other sessions look keys up); entries are
+// only modified by the one session allowed to import.
+std::map<const Localization*, std::vector<std::vector<AnswerKey>>> g_answer_keys;
+std::shared_mutex g_derived_mutex;
+
+std::vector<AnswerKey> compile_level_keys(const Localization& loc, int level) {
+    std::vector<AnswerKey> keys;
+    int count = level_lesson_count(loc, level);
+    keys.reserve(count);
+    for (int i = 0; i < count; ++i) keys.emplace_back(lesson_view(loc, level, i).solution);
+    return keys;
 }
 
-// Helper to import lesson from file
-bool import_lesson(const std::string& filename, Level& level) {
-    std::ifstream in(filename);
-    if (!in) return false;
-    std::string title, explanation, code, challenge, solution, output, hint;
-    std::getline(in, title);
-    std::getline(in, explanation);
-    std::getline(in, code);
-    std::getline(in, challenge);
-    std::getline(in, solution);
-    std::getline(in, output);
-    std::getline(in, hint);
-    Lesson l;
-    l.explanation = title + "\n" + explanation;
-    l.code = code;
-    l.challenge = challenge;
-    l.solution = solution;
-    l.expected_output = output;
-    l.hint = hint;
-    l.related_title = "";
-    l.related_level = "";
-    level.lessons.push_back(l);
-    return true;
+void compile_answer_keys(const Localization& loc) {
+    std::vector<std::vector<AnswerKey>> levels;
+    for (int level = 0; level < level_count(loc); ++level) levels.push_back(compile_level_keys(loc, level));
+    std::unique_lock<std::shared_mutex> lock(g_derived_mutex);
+    g_answer_keys[&loc] = std::move(levels);
 }
 
-// --- Main Interactive Logic ---
-int main() {
-    // std::locale::global(std::locale("")); // Removed to avoid Windows locale error
-    // std::wcout.imbue(std::locale()); // Not needed
-    int xp = 0, bookmark = 0, daily_goal = 3, daily_progress = 0;
-    int total_lessons_completed = 0, total_xp = 0, sessions_count = 0;
-    int session_counter = 0, weekly_lessons = 0, weekly_xp = 0, weekly_sessions = 0;
-    int current_week = get_week_number();
-    std::string last_goal_date = get_current_date();
-    std::string last_seen_date = get_current_date();
-    Localization* loc = &en;
-    int lang = 1;
-    int level = 0;
-    int lesson = 0;
-    bool in_review_mode = false;
-    bool instructor_mode_active = false;
+// Drop a level's keys after its lessons change (import)
+void invalidate_answer_keys(const Localization& loc, int level) {
+    std::unique_lock<std::shared_mutex> lock(g_derived_mutex);
+    auto it = g_answer_keys.find(&loc);
+    if (it != g_answer_keys.end() && level < (int)it->second.size()) it->second[level].clear();
+}
 
-    // --- Progress Load Option ---
-    bool has_progress = false;
-    int saved_lang = 1, saved_level = 0, saved_lesson = 0, saved_xp = 0, saved_bookmark = 0, saved_daily_goal = 3, saved_daily_progress = 0, saved_total_lessons_completed = 0, saved_total_xp = 0, saved_sessions_count = 0;
-    int saved_session_counter = 0, saved_weekly_lessons = 0, saved_weekly_xp = 0, saved_weekly_sessions = 0, saved_current_week = 0;
-    std::string saved_last_goal_date, saved_last_seen_date;
-    if (load_progress(saved_lang, saved_level, saved_lesson, saved_xp, saved_bookmark, saved_daily_goal, saved_daily_progress, saved_last_goal_date, saved_total_lessons_completed, saved_total_xp, saved_sessions_count, saved_last_seen_date, saved_session_counter, saved_weekly_lessons, saved_weekly_xp, saved_weekly_sessions, saved_current_week)) {
-        has_progress = true;
-        // Check if date changed for daily goal
-        std::string today = get_current_date();
-        if (saved_last_goal_date != today) {
-            saved_daily_progress = 0;
-            saved_last_goal_date = today;
+const AnswerKey& answer_key(const Localization& loc, int level, int lesson) {
+    {
+        std::shared_lock<std::shared_mutex> lock(g_derived_mutex);
+        auto it = g_answer_keys.find(&loc);
+        if (it != g_answer_keys.end() && level < (int)it->second.size() && lesson < (int)it->second[level].size()) {
+            return it->second[level][lesson];
         }
-        
-        // Check if week changed for weekly stats
-        int this_week = get_week_number();
-        if (saved_current_week != this_week) {
-            saved_weekly_lessons = 0;
-            saved_weekly_xp = 0;
-            saved_weekly_sessions = 0;
-            saved_current_week = this_week;
+    }
+    std::vector<AnswerKey> keys = compile_level_keys(loc, level);
+    std::unique_lock<std::shared_mutex> lock(g_derived_mutex);
+    std::vector<std::vector<AnswerKey>>& levels = g_answer_keys[&loc];
+    if ((int)levels.size() < level_count(loc)) levels.resize(level_count(loc));
+    levels[level] = std::move(keys);
+    return levels[level][lesson];
+}
+
+// --- Lesson Search ---
+// An inverted index over every field of every lesson of a catalog, built when
+// the catalog is first used. Latin text is split into identifier tokens
+// (push_back, sayHello and std::cout also yield their parts); Arabic words
+// are indexed whole and as character trigrams, so a word matches with or
+// without its prefixes. Results are ranked with BM25. Imports and edits
+// re-index only the lessons whose content changed.
+bool is_arabic_letter(char32_t c) { return c >= 0x621 && c <= 0x64A; }
+
+bool is_search_word_char(char32_t c) {
+    if (c < 0x80) return std::isalnum((int)c) || c == '_';
+    // General punctuation, arrows, box drawing, emoji and other symbols split words
+    return !(c >= 0x2000 && c <= 0x2BFF) && c < 0x1F000 && c != 0x60C && c != 0x61B && c != 0x61F;
+}
+
+void append_utf8(std::string& out, char32_t c) {
+    if (c < 0x80) { out += (char)c; return; }
+    if (c < 0x800) { out += (char)(0xC0 | (c >> 6)); out += (char)(0x80 | (c & 0x3F)); return; }
+    if (c < 0x10000) {
+        out += (char)(0xE0 | (c >> 12));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+        return;
+    }
+    out += (char)(0xF0 | (c >> 18));
+    out += (char)(0x80 | ((c >> 12) & 0x3F));
+    out += (char)(0x80 | ((c >> 6) & 0x3F));
+    out += (char)(0x80 | (c & 0x3F));
+}
+
+// Emits a word's search terms
+void add_word_terms(const std::u32string& raw, const std::u32string& folded, std::vector<std::string>& out) {
+    std::string whole;
+    for (char32_t c : folded) append_utf8(whole, c);
+    bool arabic = false;
+    for (char32_t c : folded) arabic = arabic || is_arabic_letter(c);
+    if (arabic) {
+        out.push_back(whole);
+        for (size_t i = 0; i + 3 <= folded.size(); ++i) {
+            std::string gram;
+            for (size_t j = i; j < i + 3; ++j) append_utf8(gram, folded[j]);
+            if (gram != whole) out.push_back(std::move(gram));
+        }
+        return;
+    }
+    bool digits = std::all_of(folded.begin(), folded.end(), [](char32_t c) { return c >= '0' && c <= '9'; });
+    if (folded.size() < 2 && !digits) return;
+    out.push_back(whole);
+    // Identifier parts: snake_case and camelCase
+    std::string part;
+    size_t parts = 0;
+    size_t first = out.size();
+    for (size_t i = 0; i <= raw.size(); ++i) {
+        bool boundary = i == raw.size() || raw[i] == '_' ||
+                        (i > 0 && raw[i] < 0x80 && std::isupper((int)raw[i]) && std::islower((int)raw[i - 1]));
+        if (boundary) {
+            if (part.size() >= 2) { out.push_back(part); ++parts; }
+            part.clear();
+            if (i < raw.size() && raw[i] != '_') append_utf8(part, folded[i]);
+        } else {
+            append_utf8(part, folded[i]);
+        }
+    }
+    if (parts == 1) out.resize(first);  // the only part is the word itself
+}
+
+void search_terms(std::string_view text, std::vector<std::string>& out) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    std::u32string raw, folded;
+    std::string previous;   // last word, for std::cout and c++ style terms
+    std::string separator;  // what came between it and the current word
+    auto flush = [&] {
+        if (raw.empty()) return;
+        std::string word;
+        for (char32_t c : folded) append_utf8(word, c);
+        add_word_terms(raw, folded, out);
+        if (!previous.empty() && separator == "::") out.push_back(previous + "::" + word);
+        previous = std::move(word);
+        separator.clear();
+        raw.clear();
+        folded.clear();
+    };
+    while (p < end) {
+        char32_t c = decode_utf8(p, end);
+        char32_t f = fold_code_point(c);
+        if (f == 0) continue;  // harakat, tatweel, zero-width marks
+        if (is_search_word_char(f)) {
+            raw.push_back(c);
+            folded.push_back(f);
+            continue;
+        }
+        bool had_word = !raw.empty();
+        flush();
+        if (f == '+' && had_word && p < end && *p == '+' && !previous.empty()) {
+            out.push_back(previous + "++");  // c++, i++
+        }
+        if (f < 0x80 && !std::isspace((int)f)) separator += (char)f;
+        else if (!had_word) separator.clear();
+        if (separator.size() > 2) separator.clear();
+    }
+    flush();
+}
+
+class SearchIndex {
+public:
+    struct Hit {
+        int level;
+        int lesson;
+        double score;
+    };
+
+    // Index a whole catalog
+    void build(const Localization& loc) {
+        for (int level = 0; level < level_count(loc); ++level) index_level(loc, level);
+        refresh_weights();
+    }
+
+    // Re-index the lessons of a level whose content changed, add new ones, drop removed ones
+    void sync_level(const Localization& loc, int level) {
+        index_level(loc, level);
+        refresh_weights();
+    }
+
+    std::vector<Hit> search(std::string_view query, size_t limit) const {
+        std::vector<std::string> terms;
+        search_terms(query, terms);
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        // Dense per-thread accumulators: served sessions search concurrently
+        thread_local std::vector<float> scores;
+        thread_local std::vector<uint32_t> touched;
+        if (scores.size() < docs_.size()) scores.resize(docs_.size(), 0.0f);
+        touched.clear();
+        double n = (double)slot_of_.size();
+        for (const std::string& term : terms) {
+            auto t = term_ids_.find(term);
+            if (t == term_ids_.end()) continue;
+            const std::vector<Posting>& list = postings_[t->second];
+            // A term in most lessons ("std") barely changes the ranking but costs the most
+            if (terms.size() > 1 && list.size() * 2 > slot_of_.size()) continue;
+            float idf = (float)std::log(1.0 + (n - list.size() + 0.5) / (list.size() + 0.5));
+            for (const Posting& posting : list) {
+                float& score = scores[posting.slot];
+                if (score == 0.0f) touched.push_back(posting.slot);
+                score += idf * posting.weight;
+            }
+        }
+        // Keep the best `limit` in a min-heap instead of sorting every match
+        auto better = [](const Hit& x, const Hit& y) {
+            if (x.score != y.score) return x.score > y.score;
+            return x.level != y.level ? x.level < y.level : x.lesson < y.lesson;
+        };
+        std::vector<Hit> hits;
+        hits.reserve(limit + 1);
+        for (uint32_t slot : touched) {
+            Hit hit{doc_level(docs_[slot].id), doc_lesson(docs_[slot].id), scores[slot]};
+            scores[slot] = 0.0f;
+            if (hits.size() == limit && !better(hit, hits.front())) continue;
+            hits.push_back(hit);
+            std::push_heap(hits.begin(), hits.end(), better);
+            if (hits.size() > limit) {
+                std::pop_heap(hits.begin(), hits.end(), better);
+                hits.pop_back();
+            }
+        }
+        std::sort(hits.begin(), hits.end(), better);
+        return hits;
+    }
+
+private:
+    void index_level(const Localization& loc, int level) {
+        int count = level_lesson_count(loc, level);
+        for (int lesson = 0; lesson < count; ++lesson) {
+            LessonView view = lesson_view(loc, level, lesson);
+            uint32_t id = doc_id(level, lesson);
+            uint64_t hash = content_hash(view);
+            auto it = slot_of_.find(id);
+            if (it != slot_of_.end() && docs_[it->second].hash == hash) continue;
+            remove(id);
+            add(id, view, hash);
+        }
+        for (auto it = slot_of_.lower_bound(doc_id(level, count)); it != slot_of_.end() && doc_level(it->first) == level;) {
+            uint32_t id = (it++)->first;
+            remove(id);
+        }
+    }
+
+    struct Posting {
+        uint32_t slot;
+        uint32_t tf;
+        float weight;  // BM25 term-frequency factor, refreshed after every change
+    };
+
+    struct Document {
+        uint32_t id = 0;
+        uint32_t length = 0;
+        uint64_t hash = 0;
+        std::vector<uint32_t> terms;  // distinct term ids, for removal
+    };
+
+    static uint32_t doc_id(int level, int lesson) { return ((uint32_t)level << 24) | (uint32_t)lesson; }
+    static int doc_level(uint32_t id) { return (int)(id >> 24); }
+    static int doc_lesson(uint32_t id) { return (int)(id & 0xFFFFFF); }
+
+    static uint64_t content_hash(const LessonView& view) {
+        uint64_t h = 0;
+        for (int f = 0; f < kLessonFieldCount; ++f) {
+            h = h * 1099511628211ull ^ std::hash<std::string_view>()(view.*kLessonViewFields[f]);
+        }
+        return h;
+    }
+
+    static bool slot_before(const Posting& p, uint32_t slot) { return p.slot < slot; }
+
+    void add(uint32_t id, const LessonView& view, uint64_t hash) {
+        std::vector<std::string> terms;
+        // The title (first line of the explanation) counts three times
+        std::string_view title = view.explanation.substr(0, view.explanation.find('\n'));
+        for (int i = 0; i < 3; ++i) search_terms(title, terms);
+        for (int f = 0; f < kLessonFieldCount; ++f) search_terms(view.*kLessonViewFields[f], terms);
+        std::unordered_map<uint32_t, uint32_t> counts;
+        for (const std::string& term : terms) {
+            auto ins = term_ids_.emplace(term, (uint32_t)postings_.size());
+            if (ins.second) postings_.emplace_back();
+            ++counts[ins.first->second];
+        }
+        uint32_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            slot = (uint32_t)docs_.size();
+            docs_.emplace_back();
+        }
+        Document& doc = docs_[slot];
+        doc.id = id;
+        doc.hash = hash;
+        doc.length = (uint32_t)terms.size();
+        doc.terms.clear();
+        total_length_ += doc.length;
+        slot_of_[id] = slot;
+        for (const auto& c : counts) {
+            std::vector<Posting>& list = postings_[c.first];
+            list.insert(std::lower_bound(list.begin(), list.end(), slot, slot_before), {slot, c.second, 0.0f});
+            doc.terms.push_back(c.first);
+        }
+    }
+
+    // Document lengths feed every weight through the average, so recompute them all
+    void refresh_weights() {
+        const double k1 = 1.2, b = 0.75;
+        double average = slot_of_.empty() ? 1.0 : (double)total_length_ / slot_of_.size();
+        for (std::vector<Posting>& list : postings_) {
+            for (Posting& p : list) {
+                double norm = k1 * (1 - b + b * docs_[p.slot].length / average);
+                p.weight = (float)(p.tf * (k1 + 1) / (p.tf + norm));
+            }
+        }
+    }
+
+    void remove(uint32_t id) {
+        auto it = slot_of_.find(id);
+        if (it == slot_of_.end()) return;
+        uint32_t slot = it->second;
+        Document& doc = docs_[slot];
+        for (uint32_t term : doc.terms) {
+            std::vector<Posting>& list = postings_[term];
+            auto at = std::lower_bound(list.begin(), list.end(), slot, slot_before);
+            if (at != list.end() && at->slot == slot) list.erase(at);
+        }
+        total_length_ -= doc.length;
+        doc.terms.clear();
+        free_slots_.push_back(slot);
+        slot_of_.erase(it);
+    }
+
+    std::unordered_map<std::string, uint32_t> term_ids_;
+    std::vector<std::vector<Posting>> postings_;  // by term id, sorted by slot
+    std::vector<Document> docs_;                  // by slot
+    std::vector<uint32_t> free_slots_;
+    std::map<uint32_t, uint32_t> slot_of_;        // doc id -> slot, in level order
+    uint64_t total_length_ = 0;
+};
+
+std::map<const Localization*, SearchIndex> g_search_indexes;  // guarded by g_derived_mutex
+
+SearchIndex& search_index(const Localization& loc) {
+    {
+        std::shared_lock<std::shared_mutex> lock(g_derived_mutex);
+        auto it = g_search_indexes.find(&loc);
+        if (it != g_search_indexes.end()) return it->second;
+    }
+    SearchIndex index;
+    index.build(loc);
+    std::unique_lock<std::shared_mutex> lock(g_derived_mutex);
+    return g_search_indexes.emplace(&loc, std::move(index)).first->second;
+}
+
+// Keeps what is derived from a level's lessons current after an import
+void catalog_level_changed(const Localization& loc, int level) {
+    invalidate_answer_keys(loc, level);
+    SearchIndex* index = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(g_derived_mutex);
+        auto it = g_search_indexes.find(&loc);
+        if (it != g_search_indexes.end()) index = &it->second;
+    }
+    if (index) index->sync_level(loc, level);
+}
+
+// Drops a retired catalog's answer keys and search index
+void forget_catalog(const Localization& loc) {
+    std::unique_lock<std::shared_mutex> lock(g_derived_mutex);
+    g_answer_keys.erase(&loc);
+    g_search_indexes.erase(&loc);
+}
+
+// --- Screen Rendering ---
+// Lesson screens are composed into one reusable buffer and written with a
+// single write(). When the previous frame is known to still be on screen
+// (nothing scrolled since it was drawn and every line fits the terminal),
+// only the lines that changed are repainted.
+struct UiSettings {
+    bool animate = true;
+    bool clear = true;
+};
+
+UiSettings g_ui;
+
+// Passes output through while counting newlines, so the renderer can tell
+// how far the screen has moved since its last frame
+class LineCountingBuffer : public std::streambuf {
+public:
+    explicit LineCountingBuffer(std::streambuf* target) : target_(target) {}
+    uint64_t lines = 0;
+
+protected:
+    int overflow(int c) override {
+        if (c == traits_type::eof()) return traits_type::not_eof(c);
+        if (c == '\n') ++lines;
+        return target_->sputc((char)c);
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        lines += (uint64_t)std::count(s, s + n, '\n');
+        return target_->sputn(s, n);
+    }
+    int sync() override { return target_->pubsync(); }
+
+private:
+    std::streambuf* target_;
+};
+
+const int kFrameSlack = 8;
+const char kClearSequence[] = "\033[H\033[2J\033[3J";
+
+class ScreenRenderer {
+public:
+    // Start a new frame; the returned buffer keeps its capacity between frames
+    std::string& begin_frame() {
+        frame_.clear();
+        return frame_;
+    }
+
+    void attach(LineCountingBuffer* counter) {
+        counter_ = counter;
+        tty_ = isatty(STDOUT_FILENO);
+    }
+
+    // Something else took over the screen (clear, full-screen output)
+    void invalidate() { valid_ = false; }
+
+    // Each line read echoes one more line onto the terminal
+    void note_input() { ++inputs_since_frame_; }
+
+    void present() {
+        split_lines(frame_, next_);
+        if (!g_ui.clear || !counter_) {
+            std::cout << frame_;
+            std::cout.flush();
+            return;
+        }
+        std::cout.flush();
+        out_.clear();
+        if (can_diff()) {
+            for (size_t i = 0; i < next_.size(); ++i) {
+                bool last = (i + 1 == next_.size());
+                if (!last && i < prev_.size() && prev_[i] == next_[i]) continue;
+                out_ += "\033[";
+                out_ += std::to_string(i + 1);
+                out_ += ";1H";
+                out_ += next_[i];
+                out_ += "\033[K";
+            }
+            // Drops leftovers: the old frame's extra lines, echoed input, feedback
+            out_ += "\033[J";
+        } else {
+            out_ += kClearSequence;
+            out_ += frame_;
+        }
+        write_all(out_);
+        prev_.swap(next_);
+        valid_ = true;
+        lines_at_frame_ = counter_->lines;
+        inputs_since_frame_ = 0;
+    }
+
+private:
+    bool can_diff() const {
+        if (!valid_ || !tty_) return false;
+        struct winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_row == 0) return false;
+        uint64_t moved = counter_->lines - lines_at_frame_ + inputs_since_frame_;
+        if (moved > (uint64_t)kFrameSlack || next_.size() + kFrameSlack > ws.ws_row || prev_.size() + kFrameSlack > ws.ws_row) return false;
+        // Byte length bounds display width, so this rejects anything that could wrap
+        for (const std::string& line : next_) if (line.size() >= ws.ws_col) return false;
+        for (const std::string& line : prev_) if (line.size() >= ws.ws_col) return false;
+        return true;
+    }
+
+    static void split_lines(const std::string& text, std::vector<std::string>& lines) {
+        size_t count = 0, start = 0;
+        while (true) {
+            size_t end = text.find('\n', start);
+            if (count == lines.size()) lines.emplace_back();
+            lines[count++].assign(text, start, end == std::string::npos ? std::string::npos : end - start);
+            if (end == std::string::npos) break;
+            start = end + 1;
+        }
+        lines.resize(count);
+    }
+
+    static void write_all(const std::string& s) {
+        size_t done = 0;
+        while (done < s.size()) {
+            ssize_t n = ::write(STDOUT_FILENO, s.data() + done, s.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            done += (size_t)n;
+        }
+    }
+
+    std::string frame_;
+    std::string out_;
+    std::vector<std::string> prev_;
+    std::vector<std::string> next_;
+    LineCountingBuffer* counter_ = nullptr;
+    bool tty_ = false;
+    bool valid_ = false;
+    uint64_t lines_at_frame_ = 0;
+    uint64_t inputs_since_frame_ = 0;
+};
+
+ScreenRenderer g_screen;
+
+// --- Session Context ---
+// A session served over the socket (--serve) runs run_session() as a
+// coroutine on a server worker thread. While it runs, t_session points at its
+// connection, so prompts, output, the frame renderer and the learner id
+// resolve per connection instead of to this process's terminal.
+struct SessionContext {
+    virtual ~SessionContext() {}
+    // Blocks the session (not the thread) until a line arrives; false on hangup
+    virtual bool read_line(std::string& out) = 0;
+
+    std::string learner_id;
+    ScreenRenderer screen;
+    std::string output;  // written by the session, not yet sent to the client
+};
+
+thread_local SessionContext* t_session = nullptr;
+
+ScreenRenderer& screen() {
+    return t_session ? t_session->screen : g_screen;
+}
+
+// --- Terminal Input & Animation ---
+// On a terminal, text animation runs on a timer-driven render thread and
+// keyboard input is read by its own thread into a small line editor. Any
+// keypress skips the running animation, and lines typed meanwhile are queued
+// and handed to the next prompt immediately (type-ahead).
+size_t utf8_length(unsigned char lead) {
+    if (lead < 0x80) return 1;
+    if ((lead >> 5) == 0x6) return 2;
+    if ((lead >> 4) == 0xE) return 3;
+    if ((lead >> 3) == 0x1E) return 4;
+    return 1;
+}
+
+void write_stdout(const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t put = ::write(STDOUT_FILENO, data, n);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return;
+        data += put;
+        n -= (size_t)put;
+    }
+}
+
+class TextAnimator {
+public:
+    TextAnimator() {}
+    TextAnimator(const TextAnimator&) = delete;
+    TextAnimator& operator=(const TextAnimator&) = delete;
+    ~TextAnimator() { stop(); }
+
+    void start() {
+        if (!thread_.joinable()) thread_ = std::thread(&TextAnimator::run, this);
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    bool running() const { return thread_.joinable(); }
+
+    // Types text out one character per tick; returns once all of it is shown
+    void play(const std::string& text, int delay_ms) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        text_ = text;
+        delay_ = std::chrono::milliseconds(delay_ms);
+        skip_ = false;
+        playing_ = true;
+        cv_.notify_all();
+        cv_.wait(lk, [this] { return !playing_; });
+    }
+
+    // Shows the rest of the current text at once (called on keypress)
+    void skip() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (playing_) {
+            skip_ = true;
+            cv_.notify_all();
+        }
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lk(mutex_);
+        for (;;) {
+            cv_.wait(lk, [this] { return stopping_ || playing_; });
+            if (!playing_) return;
+            auto tick = std::chrono::steady_clock::now();
+            size_t pos = 0;
+            while (pos < text_.size()) {
+                if (skip_ || stopping_) {
+                    write_stdout(text_.data() + pos, text_.size() - pos);
+                    break;
+                }
+                size_t len = std::min(utf8_length((unsigned char)text_[pos]), text_.size() - pos);
+                write_stdout(text_.data() + pos, len);
+                pos += len;
+                tick += delay_;
+                cv_.wait_until(lk, tick, [this] { return skip_ || stopping_; });
+            }
+            playing_ = false;
+            cv_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string text_;
+    std::chrono::milliseconds delay_{0};
+    bool playing_ = false;
+    bool skip_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+TextAnimator g_animator;
+
+struct termios g_saved_termios;
+volatile sig_atomic_t g_termios_saved = 0;
+
+// Put the terminal back before dying from Ctrl-C / kill
+void restore_terminal_and_reraise(int sig) {
+    if (g_termios_saved) tcsetattr(STDIN_FILENO, TCSANOW, &g_saved_termios);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+class TerminalInput {
+public:
+    TerminalInput() {}
+    TerminalInput(const TerminalInput&) = delete;
+    TerminalInput& operator=(const TerminalInput&) = delete;
+    ~TerminalInput() { stop(); }
+
+    // Switches a tty to non-canonical, no-echo mode and starts the reader
+    bool start() {
+        if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &g_saved_termios) != 0) return false;
+        if (pipe(wake_pipe_) != 0) return false;
+        struct termios raw = g_saved_termios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0) return false;
+        g_termios_saved = 1;
+        signal(SIGINT, restore_terminal_and_reraise);
+        signal(SIGTERM, restore_terminal_and_reraise);
+        signal(SIGHUP, restore_terminal_and_reraise);
+        thread_ = std::thread(&TerminalInput::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        char c = 0;
+        ssize_t ignored = ::write(wake_pipe_[1], &c, 1);
+        (void)ignored;
+        thread_.join();
+        ::close(wake_pipe_[0]);
+        ::close(wake_pipe_[1]);
+        tcsetattr(STDIN_FILENO, TCSANOW, &g_saved_termios);
+        g_termios_saved = 0;
+    }
+
+    bool active() const { return thread_.joinable(); }
+
+    // Next complete line; shows whatever was typed ahead. False on EOF.
+    bool read_line(std::string& out) {
+        std::cout.flush();
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (lines_.empty() && !eof_) {
+            write_stdout(editing_.data(), editing_.size());
+            waiting_ = true;
+            cv_.wait(lk, [this] { return !lines_.empty() || eof_; });
+            waiting_ = false;
+        } else if (!lines_.empty()) {
+            // Typed during animation: echo it now so the screen reads naturally
+            write_stdout(lines_.front().data(), lines_.front().size());
+            write_stdout("\n", 1);
+        }
+        if (lines_.empty()) return false;
+        out = std::move(lines_.front());
+        lines_.pop_front();
+        return true;
+    }
+
+private:
+    void run() {
+        struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+        char buf[256];
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[1].revents) return;
+            if (!(fds[0].revents & (POLLIN | POLLHUP))) continue;
+            ssize_t n = ::read(STDIN_FILENO, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            g_animator.skip();
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (n <= 0) {
+                eof_ = true;
+                cv_.notify_all();
+                return;
+            }
+            for (ssize_t i = 0; i < n; ++i) handle_byte((unsigned char)buf[i]);
+        }
+    }
+
+    // Line editing: backspace, Ctrl-U, Ctrl-D on an empty line; escape sequences are ignored
+    void handle_byte(unsigned char c) {
+        if (escape_ == 1) { escape_ = (c == '[' || c == 'O') ? 2 : 0; return; }
+        if (escape_ == 2) { if (c >= 0x40 && c <= 0x7E) escape_ = 0; return; }
+        if (c == 0x1B) { escape_ = 1; return; }
+        if (c == '\n' || c == '\r') {
+            if (waiting_) write_stdout("\n", 1);
+            lines_.push_back(std::move(editing_));
+            editing_.clear();
+            cv_.notify_all();
+        } else if (c == 0x7F || c == 0x08) {
+            if (editing_.empty()) return;
+            size_t cut = editing_.size() - 1;
+            while (cut > 0 && ((unsigned char)editing_[cut] & 0xC0) == 0x80) --cut;
+            editing_.erase(cut);
+            if (waiting_) write_stdout("\b \b", 3);
+        } else if (c == 0x15) {
+            if (waiting_) for (size_t i = 0; i < editing_.size(); ++i) write_stdout("\b \b", 3);
+            editing_.clear();
+        } else if (c == 0x04) {
+            if (editing_.empty()) { eof_ = true; cv_.notify_all(); }
+        } else if (c >= 0x20 || c == '\t') {
+            editing_ += (char)c;
+            if (waiting_) write_stdout((const char*)&c, 1);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> lines_;
+    std::string editing_;
+    bool waiting_ = false;
+    bool eof_ = false;
+    int escape_ = 0;
+    int wake_pipe_[2] = {-1, -1};
+    std::thread thread_;
+};
+
+TerminalInput g_terminal;
+
+// --- Metrics ---
+// Every lesson-loop phase and every command is timed into a histogram that
+// is always on. Histograms are log-linear in the HDR style: 8 buckets per
+// power of two of nanoseconds, so any value is within about 9% of its
+// bucket. Recording one value is three relaxed atomic adds and no lock, so
+// served sessions on many threads share them freely. The exporter (see
+// Metrics Export) writes them in Prometheus text format.
+class LatencyHistogram {
+public:
+    static const int kSubBits = 3;
+    static const int kSubBuckets = 1 << kSubBits;
+    static const int kBuckets = kSubBuckets + (64 - kSubBits) * kSubBuckets;
+
+    void record(std::chrono::steady_clock::duration elapsed) {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+        buckets_[bucket_for(v)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    // Values below kSubBuckets get a bucket each; above, the top kSubBits
+    // bits after the leading one pick the bucket within its power of two
+    static int bucket_for(uint64_t ns) {
+        if (ns < (uint64_t)kSubBuckets) return (int)ns;
+        int e = 63 - __builtin_clzll(ns);
+        int sub = (int)((ns >> (e - kSubBits)) & (kSubBuckets - 1));
+        return kSubBuckets + (e - kSubBits) * kSubBuckets + sub;
+    }
+
+    uint64_t bucket(int b) const { return buckets_[b].load(std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_ns() const { return sum_ns_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+enum class Phase : uint8_t { Render, Input, Dispatch, Persist, Clear, Animation };
+const char* const kPhaseNames[] = {"render", "input", "dispatch", "persist", "clear", "animation"};
+const size_t kPhaseCount = sizeof(kPhaseNames) / sizeof(kPhaseNames[0]);
+const size_t kMaxCommandMetrics = 32;
+
+struct Metrics {
+    LatencyHistogram phases[kPhaseCount];
+    LatencyHistogram commands[kMaxCommandMetrics];  // indexed by Command
+};
+
+Metrics g_metrics;
+
+// Times the enclosing scope into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram) : histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ~ScopedTimer() { histogram_.record(std::chrono::steady_clock::now() - started_); }
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+LatencyHistogram& phase_metric(Phase phase) { return g_metrics.phases[(size_t)phase]; }
+
+// --- Clock ---
+// Everything that depends on the date (daily goal and weekly resets,
+// reminders, event and overlay timestamps) reads the time through
+// clock_now(). --simulate sets a virtual time instead of the wall clock.
+// Dates are compared by day number, so day and week arithmetic is plain
+// integer math and unaffected by DST.
+std::atomic<int64_t> g_virtual_time{-1};  // seconds since the epoch; -1: wall clock
+
+int64_t clock_now() {
+    int64_t v = g_virtual_time.load(std::memory_order_relaxed);
+    return v >= 0 ? v : (int64_t)time(nullptr);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void civil_from_days(int64_t z, int& y, int& m, int& d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    y = (int)(yoe + era * 400 + (m <= 2));
+}
+
+// YYYY-MM-DD to a day number; false for anything else
+bool parse_date(const std::string& date, int64_t& day) {
+    int y = 0, m = 0, d = 0;
+    if (date.size() != 10 || sscanf(date.c_str(), "%4d-%2d-%2d", &y, &m, &d) != 3 || m < 1 || m > 12 || d < 1 || d > 31) return false;
+    day = days_from_civil(y, m, d);
+    return true;
+}
+
+// Today's day number in local time
+int64_t local_day(int64_t t) {
+    time_t tt = (time_t)t;
+    tm local;
+    localtime_r(&tt, &local);
+    return days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+}
+
+// What the calendar logic did; --simulate checks these against its own schedule
+struct CalendarActivity {
+    std::atomic<uint64_t> reminders{0};
+    std::atomic<uint64_t> backups{0};
+    std::atomic<uint64_t> weekly_summaries{0};
+};
+
+CalendarActivity g_calendar;
+
+std::string format_date(int64_t day) {
+    int y, m, d;
+    civil_from_days(day, y, m, d);
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%04d-%02d-%02d", y, m, d);
+    return buf;
+}
+
+// --- Helper Functions ---
+void clear_screen() {
+    if (!g_ui.clear) return;
+    ScopedTimer timer(phase_metric(Phase::Clear));
+    std::cout << kClearSequence << std::flush;
+    screen().invalidate();
+}
+
+void print_centered(const std::string& text) {
+    // Simple print, can be improved for true centering
+    std::cout << text << '\n';
+}
+
+// Typing animation utility function
+// (played on the animator thread; any keypress shows the rest at once)
+void type_text(const std::string& text, int delay_ms = 25) {
+    if (!g_ui.animate || !g_animator.running()) {
+        std::cout << text << '\n';
+        return;
+    }
+    std::cout.flush();
+    {
+        ScopedTimer timer(phase_metric(Phase::Animation));
+        g_animator.play(text, delay_ms);
+    }
+    // Written behind std::cout's back, so the last frame is no longer reliable
+    screen().invalidate();
+    std::cout << '\n';
+}
+
+// Helper to get current date as string (YYYY-MM-DD)
+std::string get_current_date() {
+    return format_date(local_day(clock_now()));
+}
+
+// Helper to get the current week: weeks (Monday to Sunday) since 1970.
+// Unlike a week-of-year number it never repeats, so a learner who returns
+// a year later, or across New Year, still gets a fresh week.
+int get_week_number() {
+    return (int)((local_day(clock_now()) + 3) / 7);
+}
+
+// Helper to get days between two dates (YYYY-MM-DD); 0 if either is not a date
+int days_between(const std::string& d1, const std::string& d2) {
+    int64_t day1, day2;
+    if (!parse_date(d1, day1) || !parse_date(d2, day2)) return 0;
+    return (int)(day2 - day1);
+}
+
+// --- Progress Store ---
+// One shared file holds every learner's progress as fixed-size binary
+// records, keyed by learner id through an open-addressing bucket table.
+// Updates rewrite a single record in place under flock(); creating or
+// growing the file builds a new image and commits it with an atomic rename.
+// Processes that still hold the old file notice the inode change on their
+// next lock and reopen.
+//
+// Layout: StoreHeader | uint32_t buckets[bucket_count] | ProgressRecord[capacity]
+// A bucket holds record index + 1, or 0 when empty.
+struct Progress {
+    int lang = 1;
+    int level = 0;
+    int lesson = 0;
+    int xp = 0;
+    int bookmark = 0;
+    int daily_goal = 3;
+    int daily_progress = 0;
+    std::string last_goal_date;
+    int total_lessons_completed = 0;
+    int total_xp = 0;
+    int sessions_count = 0;
+    std::string last_seen_date;
+    int session_counter = 0;
+    int weekly_lessons = 0;
+    int weekly_xp = 0;
+    int weekly_sessions = 0;
+    int current_week = 0;
+};
+
+const char kStoreMagic[8] = {'L', 'R', 'N', 'P', 'R', 'O', 'G', '\0'};
+const uint32_t kStoreVersion = 1;
+const uint32_t kStoreInitialCapacity = 64;
+const size_t kLearnerIdMax = 47;
+
+struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;
+    uint32_t record_count;
+    uint32_t bucket_count;
+    uint32_t reserved;
+};
+
+const uint32_t kRecordLive = 1;
+const uint32_t kRecordErased = 2;
+
+struct ProgressRecord {
+    char learner[kLearnerIdMax + 1];
+    uint32_t flags;
+    uint32_t checksum;
+    int32_t lang, level, lesson, xp, bookmark, daily_goal, daily_progress;
+    char last_goal_date[12];
+    int32_t total_lessons_completed, total_xp, sessions_count;
+    char last_seen_date[12];
+    int32_t session_counter, weekly_lessons, weekly_xp, weekly_sessions, current_week;
+    uint32_t reserved[5];
+};
+static_assert(sizeof(ProgressRecord) == 160, "ProgressRecord layout is part of the file format");
+
+uint64_t fnv1a(const void* data, size_t n, uint64_t hash = 14695981039346656037ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; ++i) { hash ^= p[i]; hash *= 1099511628211ull; }
+    return hash;
+}
+
+uint32_t record_checksum(ProgressRecord rec) {
+    rec.checksum = 0;
+    return (uint32_t)fnv1a(&rec, sizeof(rec));
+}
+
+ProgressRecord to_record(const std::string& learner, const Progress& p) {
+    ProgressRecord r;
+    std::memset(&r, 0, sizeof(r));
+    std::strncpy(r.learner, learner.c_str(), kLearnerIdMax);
+    r.flags = kRecordLive;
+    r.lang = p.lang; r.level = p.level; r.lesson = p.lesson; r.xp = p.xp; r.bookmark = p.bookmark;
+    r.daily_goal = p.daily_goal; r.daily_progress = p.daily_progress;
+    std::strncpy(r.last_goal_date, p.last_goal_date.c_str(), sizeof(r.last_goal_date) - 1);
+    r.total_lessons_completed = p.total_lessons_completed; r.total_xp = p.total_xp; r.sessions_count = p.sessions_count;
+    std::strncpy(r.last_seen_date, p.last_seen_date.c_str(), sizeof(r.last_seen_date) - 1);
+    r.session_counter = p.session_counter; r.weekly_lessons = p.weekly_lessons; r.weekly_xp = p.weekly_xp;
+    r.weekly_sessions = p.weekly_sessions; r.current_week = p.current_week;
+    r.checksum = record_checksum(r);
+    return r;
+}
+
+Progress from_record(const ProgressRecord& r) {
+    Progress p;
+    p.lang = r.lang; p.level = r.level; p.lesson = r.lesson; p.xp = r.xp; p.bookmark = r.bookmark;
+    p.daily_goal = r.daily_goal; p.daily_progress = r.daily_progress;
+    p.last_goal_date = std::string(r.last_goal_date, strnlen(r.last_goal_date, sizeof(r.last_goal_date)));
+    p.total_lessons_completed = r.total_lessons_completed; p.total_xp = r.total_xp; p.sessions_count = r.sessions_count;
+    p.last_seen_date = std::string(r.last_seen_date, strnlen(r.last_seen_date, sizeof(r.last_seen_date)));
+    p.session_counter = r.session_counter; p.weekly_lessons = r.weekly_lessons; p.weekly_xp = r.weekly_xp;
+    p.weekly_sessions = r.weekly_sessions; p.current_week = r.current_week;
+    return p;
+}
+
+bool read_full(int fd, void* buf, size_t n, uint64_t offset) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t got = pread(fd, p, n, (off_t)offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got; n -= (size_t)got; offset += (uint64_t)got;
+    }
+    return true;
+}
+
+bool write_full(int fd, const void* buf, size_t n, uint64_t offset) {
+    const char* p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t put = pwrite(fd, p, n, (off_t)offset);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put; n -= (size_t)put; offset += (uint64_t)put;
+    }
+    return true;
+}
+
+class ProgressStore {
+public:
+    ProgressStore() {}
+    ProgressStore(const ProgressStore&) = delete;
+    ProgressStore& operator=(const ProgressStore&) = delete;
+    ~ProgressStore() { if (fd_ >= 0) ::close(fd_); }
+
+    bool open(const std::string& path, std::string* error) {
+        path_ = path;
+        if (!reopen()) {
+            if (error) *error = "cannot open progress store " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+    const std::string& path() const { return path_; }
+
+    bool load(const std::string& learner, Progress& out) {
+        Lock lock(*this, LOCK_SH);
+        if (!lock.ok) return false;
+        ProgressRecord rec;
+        if (find(learner, &rec, nullptr) < 0) return false;
+        out = from_record(rec);
+        return true;
+    }
+
+    bool save(const std::string& learner, const Progress& p) {
+        Lock lock(*this, LOCK_EX);
+        if (!lock.ok) return false;
+        ProgressRecord rec = to_record(learner, p);
+        uint32_t free_bucket = 0;
+        int64_t slot = find(learner, nullptr, &free_bucket);
+        if (slot >= 0) return write_full(fd_, &rec, sizeof(rec), record_offset((uint32_t)slot));
+        if (header_.record_count >= header_.capacity) {
+            if (!grow()) return false;
+            find(learner, nullptr, &free_bucket);
+        }
+        // Record first, then bucket, then count: a crash in between leaves an
+        // unreferenced record rather than a bucket pointing at garbage.
+        uint32_t index = header_.record_count;
+        uint32_t ref = index + 1;
+        ++header_.record_count;
+        return write_full(fd_, &rec, sizeof(rec), record_offset(index)) &&
+               write_full(fd_, &ref, sizeof(ref), bucket_offset(free_bucket)) &&
+               write_full(fd_, &header_, sizeof(header_), 0);
+    }
+
+    // Erased records keep their bucket as a tombstone so probe chains stay intact
+    bool erase(const std::string& learner) {
+        Lock lock(*this, LOCK_EX);
+        if (!lock.ok) return false;
+        ProgressRecord rec;
+        int64_t slot = find(learner, &rec, nullptr);
+        if (slot < 0) return false;
+        rec.flags = kRecordErased;
+        rec.checksum = record_checksum(rec);
+        return write_full(fd_, &rec, sizeof(rec), record_offset((uint32_t)slot));
+    }
+
+    bool sync() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return fd_ >= 0 && fsync(fd_) == 0;
+    }
+
+    // Consistent image of the whole store, read under a shared lock
+    bool read_image(std::vector<char>& out) {
+        Lock lock(*this, LOCK_SH);
+        if (!lock.ok) return false;
+        struct stat st;
+        if (fstat(fd_, &st) != 0) return false;
+        out.resize((size_t)st.st_size);
+        return read_full(fd_, out.data(), out.size(), 0);
+    }
+
+private:
+    // flock() does not exclude threads sharing fd_, so take the mutex first
+    struct Lock {
+        Lock(ProgressStore& s, int op) : store(s), guard(s.mutex_) { ok = store.lock(op); }
+        ~Lock() { if (ok) flock(store.fd_, LOCK_UN); }
+        ProgressStore& store;
+        std::lock_guard<std::mutex> guard;
+        bool ok;
+    };
+
+    uint64_t bucket_offset(uint32_t bucket) const { return sizeof(StoreHeader) + (uint64_t)bucket * sizeof(uint32_t); }
+    uint64_t records_offset(const StoreHeader& h) const {
+        return (sizeof(StoreHeader) + (uint64_t)h.bucket_count * sizeof(uint32_t) + 63) & ~(uint64_t)63;
+    }
+    uint64_t record_offset(uint32_t index) const { return records_offset(header_) + (uint64_t)index * sizeof(ProgressRecord); }
+
+    // Lock the current file; if another process replaced it meanwhile, reopen and retry
+    bool lock(int op) {
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            if (fd_ < 0 && !reopen()) return false;
+            if (flock(fd_, op) != 0) return false;
+            struct stat on_disk, held;
+            if (stat(path_.c_str(), &on_disk) == 0 && fstat(fd_, &held) == 0 &&
+                on_disk.st_ino == held.st_ino && on_disk.st_dev == held.st_dev) {
+                if (read_full(fd_, &header_, sizeof(header_), 0) && valid_header(header_)) return true;
+                flock(fd_, LOCK_UN);
+                return false;
+            }
+            flock(fd_, LOCK_UN);
+            ::close(fd_);
+            fd_ = -1;
+        }
+        return false;
+    }
+
+    bool valid_header(const StoreHeader& h) const {
+        return std::memcmp(h.magic, kStoreMagic, sizeof(kStoreMagic)) == 0 && h.version == kStoreVersion &&
+               h.record_size == sizeof(ProgressRecord) && h.bucket_count != 0 &&
+               (h.bucket_count & (h.bucket_count - 1)) == 0 && h.record_count <= h.capacity;
+    }
+
+    bool reopen() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd_ >= 0) return true;
+        if (errno != ENOENT) return false;
+        // Create an empty store; link() refuses to clobber one made concurrently
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        if (!write_image(tmp, kStoreInitialCapacity, std::vector<ProgressRecord>())) return false;
+        if (link(tmp.c_str(), path_.c_str()) != 0 && errno != EEXIST) { unlink(tmp.c_str()); return false; }
+        unlink(tmp.c_str());
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+        return fd_ >= 0;
+    }
+
+    // Probe for learner. Returns the record index, or -1 with *free_bucket set
+    // to the first empty bucket on its probe chain.
+    int64_t find(const std::string& learner, ProgressRecord* out, uint32_t* free_bucket) {
+        uint32_t mask = header_.bucket_count - 1;
+        uint32_t b = (uint32_t)fnv1a(learner.data(), learner.size()) & mask;
+        for (uint32_t probes = 0; probes < header_.bucket_count; ++probes, b = (b + 1) & mask) {
+            uint32_t ref = 0;
+            if (!read_full(fd_, &ref, sizeof(ref), bucket_offset(b))) return -1;
+            if (ref == 0) {
+                if (free_bucket) *free_bucket = b;
+                return -1;
+            }
+            if (ref > header_.record_count) continue;
+            ProgressRecord rec;
+            if (!read_full(fd_, &rec, sizeof(rec), record_offset(ref - 1))) return -1;
+            if (rec.flags != kRecordLive || rec.checksum != record_checksum(rec)) continue;
+            if (learner.compare(0, std::string::npos, rec.learner, strnlen(rec.learner, sizeof(rec.learner))) != 0) continue;
+            if (out) *out = rec;
+            return (int64_t)(ref - 1);
+        }
+        return -1;
+    }
+
+    // Write a complete store image holding records to path (fsynced)
+    bool write_image(const std::string& path, uint32_t capacity, const std::vector<ProgressRecord>& records) {
+        StoreHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, kStoreMagic, sizeof(kStoreMagic));
+        h.version = kStoreVersion;
+        h.record_size = sizeof(ProgressRecord);
+        h.capacity = capacity;
+        h.record_count = (uint32_t)records.size();
+        h.bucket_count = 1;
+        while (h.bucket_count < capacity * 2) h.bucket_count <<= 1;
+        std::vector<uint32_t> buckets(h.bucket_count, 0);
+        for (uint32_t i = 0; i < records.size(); ++i) {
+            uint32_t b = (uint32_t)fnv1a(records[i].learner, strnlen(records[i].learner, sizeof(records[i].learner))) & (h.bucket_count - 1);
+            while (buckets[b] != 0) b = (b + 1) & (h.bucket_count - 1);
+            buckets[b] = i + 1;
+        }
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        bool ok = write_full(fd, &h, sizeof(h), 0) &&
+                  write_full(fd, buckets.data(), buckets.size() * sizeof(uint32_t), sizeof(StoreHeader)) &&
+                  ftruncate(fd, (off_t)(records_offset(h) + (uint64_t)capacity * sizeof(ProgressRecord))) == 0 &&
+                  (records.empty() || write_full(fd, records.data(), records.size() * sizeof(ProgressRecord), records_offset(h))) &&
+                  fsync(fd) == 0;
+        ::close(fd);
+        if (!ok) unlink(path.c_str());
+        return ok;
+    }
+
+    // Double the capacity, dropping erased records; caller holds LOCK_EX
+    bool grow() {
+        std::vector<ProgressRecord> live;
+        live.reserve(header_.record_count);
+        for (uint32_t i = 0; i < header_.record_count; ++i) {
+            ProgressRecord rec;
+            if (!read_full(fd_, &rec, sizeof(rec), record_offset(i))) return false;
+            if (rec.flags == kRecordLive && rec.checksum == record_checksum(rec)) live.push_back(rec);
+        }
+        uint32_t capacity = header_.capacity;
+        while (capacity <= live.size() * 2) capacity *= 2;
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        if (!write_image(tmp, capacity, live)) return false;
+        if (std::rename(tmp.c_str(), path_.c_str()) != 0) { unlink(tmp.c_str()); return false; }
+        // Keep holding the exclusive lock on the new file while the caller finishes
+        int fd = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) return false;
+        if (flock(fd, LOCK_EX) != 0) { ::close(fd); return false; }
+        flock(fd_, LOCK_UN);
+        ::close(fd_);
+        fd_ = fd;
+        return read_full(fd_, &header_, sizeof(header_), 0) && valid_header(header_);
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    StoreHeader header_;
+    std::mutex mutex_;
+};
+
+// Shared store and the learner this process acts for (--store, --learner)
+std::string g_store_path = "progress.db";
+std::string g_learner_id;
+ProgressStore g_progress_store;
+
+const std::string& current_learner() {
+    return t_session ? t_session->learner_id : g_learner_id;
+}
+
+// --- Progress Journal ---
+// save_progress() no longer touches the store. It diffs the learner's state
+// against what was last submitted and pushes the changed fields onto a
+// lock-free queue; a background writer appends them to progress.db.journal
+// as checksummed delta records. Deltas carry absolute values, so replaying a
+// record twice is harmless: compaction folds the journal into the store,
+// fsyncs it and only then truncates the journal. On open, any records left
+// by a crashed process are replayed up to the first torn one.
+const int kProgressFieldCount = 17;
+const uint32_t kJournalMagic = 0x4a4e524c; // "LRNJ"
+const off_t kJournalCompactBytes = 64 * 1024;
+
+// Dates travel through the journal as YYYYMMDD
+int32_t encode_date(const std::string& date) {
+    int y = 0, m = 0, d = 0;
+    if (sscanf(date.c_str(), "%d-%d-%d", &y, &m, &d) != 3) return 0;
+    return y * 10000 + m * 100 + d;
+}
+
+std::string decode_date(int32_t v) {
+    if (v <= 0) return "";
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%04d-%02d-%02d", v / 10000, (v / 100) % 100, v % 100);
+    return buf;
+}
+
+void progress_to_fields(const Progress& p, int32_t f[kProgressFieldCount]) {
+    f[0] = p.lang; f[1] = p.level; f[2] = p.lesson; f[3] = p.xp; f[4] = p.bookmark;
+    f[5] = p.daily_goal; f[6] = p.daily_progress; f[7] = encode_date(p.last_goal_date);
+    f[8] = p.total_lessons_completed; f[9] = p.total_xp; f[10] = p.sessions_count;
+    f[11] = encode_date(p.last_seen_date); f[12] = p.session_counter; f[13] = p.weekly_lessons;
+    f[14] = p.weekly_xp; f[15] = p.weekly_sessions; f[16] = p.current_week;
+}
+
+void apply_progress_field(Progress& p, int field, int32_t v) {
+    switch (field) {
+        case 0: p.lang = v; break;
+        case 1: p.level = v; break;
+        case 2: p.lesson = v; break;
+        case 3: p.xp = v; break;
+        case 4: p.bookmark = v; break;
+        case 5: p.daily_goal = v; break;
+        case 6: p.daily_progress = v; break;
+        case 7: p.last_goal_date = decode_date(v); break;
+        case 8: p.total_lessons_completed = v; break;
+        case 9: p.total_xp = v; break;
+        case 10: p.sessions_count = v; break;
+        case 11: p.last_seen_date = decode_date(v); break;
+        case 12: p.session_counter = v; break;
+        case 13: p.weekly_lessons = v; break;
+        case 14: p.weekly_xp = v; break;
+        case 15: p.weekly_sessions = v; break;
+        case 16: p.current_week = v; break;
+    }
+}
+
+uint32_t crc32(const void* data, size_t n, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Bounded multi-producer/multi-consumer queue (Vyukov); push and pop never block
+template <typename T, size_t N>
+class BoundedQueue {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+public:
+    BoundedQueue() {
+        for (size_t i = 0; i < N; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & (N - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& value) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & (N - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + N, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    Cell cells_[N];
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// One queued update: the fields of a learner that changed since the last one
+struct ProgressDelta {
+    char learner[kLearnerIdMax + 1];
+    uint32_t dirty;
+    int32_t fields[kProgressFieldCount];
+};
+
+class ProgressJournal {
+public:
+    ProgressJournal(ProgressStore& store) : store_(store) {}
+    ProgressJournal(const ProgressJournal&) = delete;
+    ProgressJournal& operator=(const ProgressJournal&) = delete;
+    ~ProgressJournal() { close(); }
+
+    // Opens the journal, replays whatever a previous run left behind and
+    // starts the writer thread
+    bool open(const std::string& path, std::string* error) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            if (error) *error = "cannot open journal " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        compact();
+        writer_ = std::thread(&ProgressJournal::run, this);
+        return true;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Called from the interactive path: no I/O, only a diff and a queue push
+    void submit(const std::string& learner, const Progress& p) {
+        ProgressDelta d;
+        std::memset(&d, 0, sizeof(d));
+        std::strncpy(d.learner, learner.c_str(), kLearnerIdMax);
+        progress_to_fields(p, d.fields);
+        {
+            // Served sessions submit from several worker threads
+            std::lock_guard<std::mutex> lk(baselines_mutex_);
+            Baseline& base = baselines_[learner];
+            for (int f = 0; f < kProgressFieldCount; ++f) {
+                if (!base.valid || base.fields[f] != d.fields[f]) d.dirty |= 1u << f;
+            }
+            if (d.dirty == 0) return;
+            std::memcpy(base.fields, d.fields, sizeof(d.fields));
+            base.valid = true;
+        }
+        while (!queue_.push(d)) std::this_thread::yield();
+        pending_.store(true, std::memory_order_release);
+        { std::lock_guard<std::mutex> lk(wake_mutex_); }
+        wake_.notify_one();
+    }
+
+    // Last state submitted for a learner by this process, which may not have
+    // reached the store yet (a server session reconnecting before compaction)
+    bool latest(const std::string& learner, Progress& p) {
+        std::lock_guard<std::mutex> lk(baselines_mutex_);
+        auto it = baselines_.find(learner);
+        if (it == baselines_.end() || !it->second.valid) return false;
+        for (int f = 0; f < kProgressFieldCount; ++f) apply_progress_field(p, f, it->second.fields[f]);
+        return true;
+    }
+
+    // Drain the queue, fold the journal into the store and stop the writer
+    void close() {
+        if (!writer_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lk(wake_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    struct Baseline {
+        int32_t fields[kProgressFieldCount];
+        bool valid = false;
+    };
+
+    void run() {
+        std::vector<char> batch;
+        for (;;) {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lk(wake_mutex_);
+                wake_.wait_for(lk, std::chrono::seconds(5), [this] {
+                    return stopping_ || pending_.load(std::memory_order_acquire);
+                });
+                stopping = stopping_;
+            }
+            pending_.store(false, std::memory_order_relaxed);
+            batch.clear();
+            ProgressDelta d;
+            while (queue_.pop(d)) encode(d, batch);
+            if (!batch.empty()) append(batch);
+            if (stopping) break;
+            struct stat st;
+            if (fstat(fd_, &st) == 0 && st.st_size >= kJournalCompactBytes) compact();
+        }
+        compact();
+    }
+
+    // Record: magic, payload size, sequence, dirty mask, learner, values, crc32
+    void encode(const ProgressDelta& d, std::vector<char>& out) {
+        size_t start = out.size();
+        uint8_t learner_len = (uint8_t)strnlen(d.learner, sizeof(d.learner));
+        uint32_t size = 0;
+        uint64_t seq = ++sequence_;
+        auto put = [&out](const void* p, size_t n) { out.insert(out.end(), (const char*)p, (const char*)p + n); };
+        put(&kJournalMagic, 4);
+        put(&size, 4);
+        put(&seq, 8);
+        put(&d.dirty, 4);
+        put(&learner_len, 1);
+        put(d.learner, learner_len);
+        for (int f = 0; f < kProgressFieldCount; ++f) {
+            if (d.dirty & (1u << f)) put(&d.fields[f], 4);
+        }
+        size = (uint32_t)(out.size() - start - 8);
+        std::memcpy(&out[start + 4], &size, 4);
+        uint32_t crc = crc32(&out[start], out.size() - start);
+        put(&crc, 4);
+    }
+
+    void append(const std::vector<char>& batch) {
+        if (flock(fd_, LOCK_EX) != 0) return;
+        size_t done = 0;
+        while (done < batch.size()) {
+            ssize_t n = ::write(fd_, batch.data() + done, batch.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += (size_t)n;
+        }
+        fdatasync(fd_);
+        flock(fd_, LOCK_UN);
+    }
+
+    // Replay every intact record into the store, sync it, then empty the journal
+    void compact() {
+        if (flock(fd_, LOCK_EX) != 0) return;
+        struct stat st;
+        if (fstat(fd_, &st) == 0 && st.st_size > 0) {
+            std::vector<char> buf((size_t)st.st_size);
+            if (read_full(fd_, buf.data(), buf.size(), 0)) {
+                std::unordered_map<std::string, Progress> folded;
+                size_t pos = 0;
+                while (pos + 24 <= buf.size()) {
+                    uint32_t magic, size, dirty;
+                    std::memcpy(&magic, &buf[pos], 4);
+                    std::memcpy(&size, &buf[pos + 4], 4);
+                    if (magic != kJournalMagic || size < 13 || pos + 8 + size + 4 > buf.size()) break;
+                    uint32_t crc;
+                    std::memcpy(&crc, &buf[pos + 8 + size], 4);
+                    if (crc != crc32(&buf[pos], 8 + size)) break;
+                    std::memcpy(&dirty, &buf[pos + 16], 4);
+                    uint8_t learner_len = (uint8_t)buf[pos + 20];
+                    const char* values = &buf[pos + 21 + learner_len];
+                    std::string learner(&buf[pos + 21], learner_len);
+                    auto it = folded.find(learner);
+                    if (it == folded.end()) {
+                        it = folded.emplace(learner, Progress()).first;
+                        store_.load(learner, it->second);
+                    }
+                    for (int f = 0; f < kProgressFieldCount; ++f) {
+                        if (!(dirty & (1u << f))) continue;
+                        int32_t v;
+                        std::memcpy(&v, values, 4);
+                        values += 4;
+                        apply_progress_field(it->second, f, v);
+                    }
+                    pos += 8 + size + 4;
+                }
+                bool stored = true;
+                for (const auto& entry : folded) stored = store_.save(entry.first, entry.second) && stored;
+                // A torn tail is dropped; anything we could not store stays for the next try
+                if (stored && store_.sync()) ftruncate(fd_, 0);
+            }
+        }
+        flock(fd_, LOCK_UN);
+    }
+
+    ProgressStore& store_;
+    int fd_ = -1;
+    uint64_t sequence_ = 0;
+    std::unordered_map<std::string, Baseline> baselines_;
+    std::mutex baselines_mutex_;
+    BoundedQueue<ProgressDelta, 1024> queue_;
+    std::atomic<bool> pending_{false};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+ProgressJournal g_progress_journal(g_progress_store);
+
+// Default learner id: $LEARN_LEARNER, then $USER, then "default"
+std::string default_learner_id() {
+    const char* env = getenv("LEARN_LEARNER");
+    if (!env || !*env) env = getenv("USER");
+    std::string id = (env && *env) ? env : "default";
+    return id.substr(0, kLearnerIdMax);
+}
+
+// Parse the single-line progress.txt written by older versions
+bool load_legacy_progress(const std::string& path, Progress& p) {
+    std::ifstream in(path);
+    if (!in) return false;
+    in >> p.lang >> p.level >> p.lesson >> p.xp >> p.bookmark >> p.daily_goal >> p.daily_progress >> p.last_goal_date >> p.total_lessons_completed >> p.total_xp >> p.sessions_count >> p.last_seen_date >> p.session_counter >> p.weekly_lessons >> p.weekly_xp >> p.weekly_sessions >> p.current_week;
+    return (bool)in;
+}
+
+// Progress save/load helpers
+void save_progress(const Progress& p) {
+    if (!g_progress_store.is_open()) return;
+    ScopedTimer timer(phase_metric(Phase::Persist));
+    if (g_progress_journal.is_open()) g_progress_journal.submit(current_learner(), p);
+    else g_progress_store.save(current_learner(), p);
+}
+
+bool load_progress(Progress& p) {
+    if (!g_progress_store.is_open()) return false;
+    if (g_progress_journal.is_open() && g_progress_journal.latest(current_learner(), p)) return true;
+    if (g_progress_store.load(current_learner(), p)) return true;
+    // One-time migration of a legacy progress.txt in the working directory.
+    // It belongs to whoever ran here before, so only the default learner takes it.
+    if (current_learner() == default_learner_id() && load_legacy_progress("progress.txt", p) && g_progress_store.save(current_learner(), p)) {
+        std::rename("progress.txt", "progress.txt.migrated");
+        return true;
+    }
+    return false;
+}
+
+void delete_progress() {
+    g_progress_store.erase(current_learner());
+}
+
+// --- Progress Snapshots ---
+// Backups are numbered snapshots of the progress store in <store>.snapshots/.
+// The oldest kept generation is a full image; every later one stores only
+// its XOR against the previous image, which is nearly all zeros because
+// records are rewritten in place. Payloads are compressed with a small LZ77
+// codec (below). Each snapshot carries a crc32 of its payload and of the
+// image it rebuilds, so any generation can be verified and restored. Only
+// the newest generations are kept (--backup-generations): when the oldest
+// is dropped, the next one is rewritten as a full image first. Snapshots
+// are taken on their own thread, never on the path to the first prompt.
+//
+// Codec: sequences of token byte (literal count << 4 | match length - 4,
+// 15 in either half continues in 255-terminated extra bytes), literals,
+// then a 16-bit little-endian match offset. The last sequence is literals only.
+const size_t kLzMinMatch = 4;
+const size_t kLzHashBits = 14;
+
+void lz_put_length(std::string& out, size_t n) {
+    for (; n >= 255; n -= 255) out += (char)255;
+    out += (char)n;
+}
+
+std::string lz_compress(const char* in, size_t n) {
+    std::string out;
+    out.reserve(n / 2 + 16);
+    std::vector<uint32_t> table((size_t)1 << kLzHashBits, UINT32_MAX);
+    auto hash = [in](size_t i) {
+        uint32_t v;
+        std::memcpy(&v, in + i, 4);
+        return (v * 2654435761u) >> (32 - kLzHashBits);
+    };
+    size_t anchor = 0, i = 0;
+    // Matches stop short of the end so the last bytes are always literals
+    size_t limit = n > 12 ? n - 12 : 0;
+    while (i < limit) {
+        uint32_t h = hash(i);
+        uint32_t candidate = table[h];
+        table[h] = (uint32_t)i;
+        if (candidate == UINT32_MAX || i - candidate > 0xFFFF || std::memcmp(in + candidate, in + i, kLzMinMatch) != 0) {
+            ++i;
+            continue;
+        }
+        size_t match = kLzMinMatch;
+        while (i + match < n - 5 && in[candidate + match] == in[i + match]) ++match;
+        size_t literals = i - anchor;
+        size_t token_match = match - kLzMinMatch;
+        out += (char)((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(token_match, 15));
+        if (literals >= 15) lz_put_length(out, literals - 15);
+        out.append(in + anchor, literals);
+        uint16_t offset = (uint16_t)(i - candidate);
+        out += (char)(offset & 0xFF);
+        out += (char)(offset >> 8);
+        if (token_match >= 15) lz_put_length(out, token_match - 15);
+        i += match;
+        anchor = i;
+    }
+    size_t literals = n - anchor;
+    out += (char)(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) lz_put_length(out, literals - 15);
+    out.append(in + anchor, literals);
+    return out;
+}
+
+// False on malformed input or a size mismatch; never reads or writes out of bounds
+bool lz_decompress(const char* in, size_t n, char* out, size_t out_size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(in);
+    const unsigned char* end = p + n;
+    size_t o = 0;
+    auto get_length = [&p, end](size_t& length) {
+        for (;;) {
+            if (p >= end) return false;
+            unsigned char b = *p++;
+            length += b;
+            if (b != 255) return true;
+        }
+    };
+    while (p < end) {
+        unsigned char token = *p++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(literals)) return false;
+        if ((size_t)(end - p) < literals || out_size - o < literals) return false;
+        std::memcpy(out + o, p, literals);
+        p += literals;
+        o += literals;
+        if (p == end) break;
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        size_t match = token & 15;
+        if (match == 15 && !get_length(match)) return false;
+        match += kLzMinMatch;
+        if (offset == 0 || offset > o || out_size - o < match) return false;
+        for (size_t k = 0; k < match; ++k, ++o) out[o] = out[o - offset];
+    }
+    return o == out_size;
+}
+
+const char kSnapshotMagic[8] = {'L', 'R', 'N', 'S', 'N', 'A', 'P', '\0'};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t generation;
+    uint64_t base;          // generation this is a delta against; 0 for a full image
+    uint64_t image_size;
+    uint64_t payload_size;  // compressed
+    int64_t time;
+    uint32_t image_crc;
+    uint32_t payload_crc;
+};
+
+struct SnapshotInfo {
+    SnapshotHeader header;
+    bool ok = false;  // payload and rebuilt image both check out
+    std::string error;
+};
+
+// Replace the store file with an image the way the store itself grows: a
+// new file renamed over the old one under its lock, so other processes
+// reopen it on their next access
+bool replace_store_image(const std::string& path, const std::vector<char>& image, std::string* error) {
+    std::string tmp = path + ".restore." + std::to_string(getpid());
+    int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = out >= 0 && write_full(out, image.data(), image.size(), 0) && fsync(out) == 0;
+    if (out >= 0) ::close(out);
+    int current = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (current >= 0) flock(current, LOCK_EX);
+    ok = ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (current >= 0) ::close(current);
+    if (!ok) {
+        if (error) *error = "cannot replace " + path + ": " + std::strerror(errno);
+        unlink(tmp.c_str());
+    }
+    return ok;
+}
+
+class ProgressSnapshots {
+public:
+    ProgressSnapshots() {}
+    ProgressSnapshots(const ProgressSnapshots&) = delete;
+    ProgressSnapshots& operator=(const ProgressSnapshots&) = delete;
+    ~ProgressSnapshots() { stop(); }
+
+    void configure(const std::string& dir, int keep) {
+        dir_ = dir;
+        keep_ = std::max(1, keep);
+    }
+
+    const std::string& dir() const { return dir_; }
+    uint64_t taken() const { return taken_.load(); }
+    uint64_t bytes_written() const { return bytes_written_.load(); }
+
+    // Asks the snapshot thread for a snapshot of the store; returns at once.
+    // Requests made while one is pending are folded into it.
+    void request(ProgressStore& store) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        store_ = &store;
+        pending_ = true;
+        if (!thread_.joinable()) {
+            stopping_ = false;
+            thread_ = std::thread(&ProgressSnapshots::run, this);
+        }
+        wake_.notify_one();
+    }
+
+    // Finishes a pending snapshot, then stops the thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (!thread_.joinable()) return;
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    bool take(ProgressStore& store, std::string* error) {
+        std::vector<char> image;
+        if (!store.read_image(image)) {
+            if (error) *error = "cannot read progress store " + store.path();
+            return false;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        // Processes sharing the store take turns numbering generations
+        int lock_fd = ::open((dir_ + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+            if (error) *error = "cannot lock " + dir_ + ": " + std::strerror(errno);
+            if (lock_fd >= 0) ::close(lock_fd);
+            return false;
+        }
+        bool ok = take_locked(image, error);
+        ::close(lock_fd);
+        return ok;
+    }
+
+    // Every snapshot on disk, oldest first, each checked through its chain
+    std::vector<SnapshotInfo> list() {
+        std::vector<SnapshotInfo> infos;
+        for (uint64_t generation : generations()) {
+            SnapshotInfo info;
+            std::memset(&info.header, 0, sizeof(info.header));
+            info.header.generation = generation;
+            std::vector<char> image;
+            info.ok = load_image(generation, image, &info.header, &info.error);
+            infos.push_back(info);
+        }
+        return infos;
+    }
+
+    // Puts a generation back as the store. Journal records not yet folded in
+    // are newer than any snapshot, so they are dropped with it.
+    bool restore(uint64_t generation, const std::string& store_path, std::string* error) {
+        std::vector<char> image;
+        if (!load_image(generation, image, nullptr, error)) return false;
+        int journal = ::open((store_path + ".journal").c_str(), O_RDWR | O_CLOEXEC);
+        if (journal >= 0) flock(journal, LOCK_EX);
+        bool ok = replace_store_image(store_path, image, error);
+        if (journal >= 0) {
+            if (ok) ftruncate(journal, 0);
+            ::close(journal);
+        }
+        return ok;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lk(mutex_);
+        for (;;) {
+            wake_.wait(lk, [this] { return pending_ || stopping_; });
+            if (pending_) {
+                pending_ = false;
+                ProgressStore* store = store_;
+                lk.unlock();
+                std::string error;
+                if (!take(*store, &error)) std::cerr << "Backup failed: " << error << std::endl;
+                lk.lock();
+                continue;
+            }
+            if (stopping_) return;
+        }
+    }
+
+    std::string file_for(uint64_t generation) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%010llu.snap", (unsigned long long)generation);
+        return dir_ + name;
+    }
+
+    std::vector<uint64_t> generations() const {
+        std::vector<uint64_t> found;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            if (it->path().extension() == ".snap") found.push_back(std::strtoull(name.c_str(), nullptr, 10));
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    bool read_snapshot(uint64_t generation, SnapshotHeader& h, std::string& payload, std::string* error) const {
+        std::string path = file_for(generation);
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        bool ok = fd >= 0 && read_full(fd, &h, sizeof(h), 0) && std::memcmp(h.magic, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0 &&
+                  h.generation == generation && h.payload_size <= (1ull << 34);
+        if (ok) {
+            payload.resize((size_t)h.payload_size);
+            ok = read_full(fd, &payload[0], payload.size(), sizeof(h)) && crc32(payload.data(), payload.size()) == h.payload_crc;
+        }
+        if (fd >= 0) ::close(fd);
+        if (!ok && error) *error = "snapshot " + std::to_string(generation) + " is missing or corrupt";
+        return ok;
+    }
+
+    // Rebuilds a generation's image by applying its chain of deltas to the full image under it
+    bool load_image(uint64_t generation, std::vector<char>& image, SnapshotHeader* header, std::string* error) {
+        if (generation == cached_generation_ && !cached_image_.empty()) {
+            image = cached_image_;
+            if (header) *header = cached_header_;
+            return true;
+        }
+        std::vector<std::pair<SnapshotHeader, std::string>> chain;
+        for (uint64_t g = generation;;) {
+            SnapshotHeader h;
+            std::string payload;
+            if (!read_snapshot(g, h, payload, error)) return false;
+            chain.emplace_back(h, std::move(payload));
+            if (h.base == 0) break;
+            if (h.base >= g) {
+                if (error) *error = "snapshot " + std::to_string(g) + " has a bad base";
+                return false;
+            }
+            g = h.base;
+        }
+        if (header) *header = chain.front().first;
+        image.clear();
+        std::vector<char> decoded;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            const SnapshotHeader& h = it->first;
+            decoded.assign((size_t)h.image_size, '\0');
+            if (!lz_decompress(it->second.data(), it->second.size(), decoded.data(), decoded.size())) {
+                if (error) *error = "snapshot " + std::to_string(h.generation) + " does not decompress";
+                return false;
+            }
+            for (size_t i = 0; i < decoded.size() && i < image.size(); ++i) decoded[i] ^= image[i];
+            image.swap(decoded);
+            if (crc32(image.data(), image.size()) != h.image_crc) {
+                if (error) *error = "snapshot " + std::to_string(h.generation) + " does not match its checksum";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool write_snapshot(const SnapshotHeader& base_header, const std::vector<char>& image, const std::vector<char>* previous, std::string* error) {
+        SnapshotHeader h = base_header;
+        std::memcpy(h.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+        h.image_size = image.size();
+        h.image_crc = crc32(image.data(), image.size());
+        std::string payload;
+        if (previous) {
+            std::vector<char> delta(image);
+            for (size_t i = 0; i < delta.size() && i < previous->size(); ++i) delta[i] ^= (*previous)[i];
+            payload = lz_compress(delta.data(), delta.size());
+        } else {
+            payload = lz_compress(image.data(), image.size());
+        }
+        h.payload_size = payload.size();
+        h.payload_crc = crc32(payload.data(), payload.size());
+        std::string path = file_for(h.generation);
+        std::string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool ok = fd >= 0 && write_full(fd, &h, sizeof(h), 0) && write_full(fd, payload.data(), payload.size(), sizeof(h)) && fdatasync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        ok = ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+        if (!ok) {
+            if (error) *error = "cannot write " + path + ": " + std::strerror(errno);
+            unlink(tmp.c_str());
+        }
+        if (ok) bytes_written_ += sizeof(h) + payload.size();
+        return ok;
+    }
+
+    bool take_locked(const std::vector<char>& image, std::string* error) {
+        std::vector<uint64_t> existing = generations();
+        SnapshotHeader h;
+        std::memset(&h, 0, sizeof(h));
+        h.generation = existing.empty() ? 1 : existing.back() + 1;
+        h.time = clock_now();
+        std::vector<char> previous;
+        // A broken newest generation is not built upon: start again from a full image
+        bool delta = !existing.empty() && load_image(existing.back(), previous, nullptr, nullptr);
+        h.base = delta ? existing.back() : 0;
+        if (!write_snapshot(h, image, delta ? &previous : nullptr, error)) return false;
+        ++taken_;
+        cached_generation_ = h.generation;
+        cached_image_ = image;
+        cached_header_ = h;
+        cached_header_.image_crc = crc32(image.data(), image.size());
+
+        // Rotate: the oldest kept generation becomes a full image
+        existing.push_back(h.generation);
+        while (existing.size() > (size_t)keep_) {
+            uint64_t oldest = existing.front();
+            existing.erase(existing.begin());
+            SnapshotHeader next;
+            std::string payload;
+            std::vector<char> rebased;
+            if (read_snapshot(existing.front(), next, payload, nullptr) && next.base != 0) {
+                if (!load_image(existing.front(), rebased, &next, error)) return false;
+                next.base = 0;
+                if (!write_snapshot(next, rebased, nullptr, error)) return false;
+            }
+            unlink(file_for(oldest).c_str());
+        }
+        return true;
+    }
+
+    std::string dir_;
+    int keep_ = 8;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    ProgressStore* store_ = nullptr;
+    bool pending_ = false;
+    bool stopping_ = false;
+    std::atomic<uint64_t> taken_{0};
+    std::atomic<uint64_t> bytes_written_{0};
+    // The newest image this process wrote, so the next delta needs no rebuild
+    uint64_t cached_generation_ = 0;
+    std::vector<char> cached_image_;
+    SnapshotHeader cached_header_;
+};
+
+ProgressSnapshots g_snapshots;
+
+// --- Input & Batch Mode ---
+// All prompts read through read_line() and all "press Enter" pauses go
+// through wait_for_enter(). In batch mode (--batch <script>) the lines come
+// from a script instead of the terminal, pauses are skipped, and every line
+// consumed is written to a JSON-lines transcript with the learner's state
+// after it was handled and how long handling took.
+struct CommandTiming {
+    uint64_t count = 0;
+    double total_us = 0;
+    double max_us = 0;
+};
+
+struct BatchRun {
+    bool active = false;
+    std::vector<std::string> script;
+    size_t next = 0;
+    int runs = 1;
+    std::ostream* transcript = nullptr;
+    const Progress* progress = nullptr;
+    // The line currently being handled
+    bool in_flight = false;
+    std::string input;
+    std::string context;
+    std::chrono::steady_clock::time_point started;
+    uint64_t seq = 0;
+    std::map<std::string, CommandTiming> timings;
+};
+
+BatchRun g_batch;
+
+std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += (char)c; }
+        else if (c == '\n') out += "\\n";
+        else if (c < 0x20) { char buf[8]; snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out += (char)c;
+    }
+    return out;
+}
+
+// Close the timing of the line in flight and write its transcript record
+void finish_batch_command() {
+    if (!g_batch.in_flight) return;
+    g_batch.in_flight = false;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - g_batch.started).count();
+    // Commands are summarized by name; free text (answers, notes) by context
+    CommandTiming& t = g_batch.timings[g_batch.context == "command" ? g_batch.input : "(" + g_batch.context + ")"];
+    t.count++;
+    t.total_us += us;
+    t.max_us = std::max(t.max_us, us);
+    std::ostream& out = *g_batch.transcript;
+    out << "{\"seq\":" << ++g_batch.seq << ",\"context\":\"" << g_batch.context << "\",\"input\":\"" << json_escape(g_batch.input)
+        << "\",\"us\":" << std::fixed << std::setprecision(1) << us;
+    if (g_batch.progress) {
+        const Progress& p = *g_batch.progress;
+        out << ",\"lang\":" << p.lang << ",\"level\":" << p.level << ",\"lesson\":" << p.lesson << ",\"xp\":" << p.xp
+            << ",\"daily_progress\":" << p.daily_progress;
+    }
+    out << "}\n";
+}
+
+// Returns false once input is exhausted (end of script, or EOF on stdin)
+bool read_line(std::string& out, const char* context = "command") {
+    if (!g_batch.active) {
+        if (t_session) return t_session->read_line(out);
+        g_screen.note_input();
+        if (g_terminal.active()) return g_terminal.read_line(out);
+        return (bool)std::getline(std::cin, out);
+    }
+    finish_batch_command();
+    if (g_batch.next >= g_batch.script.size()) return false;
+    out = g_batch.script[g_batch.next++];
+    g_batch.in_flight = true;
+    g_batch.input = out;
+    g_batch.context = context;
+    g_batch.started = std::chrono::steady_clock::now();
+    return true;
+}
+
+void wait_for_enter() {
+    if (g_batch.active) return;
+    std::string ignored;
+    read_line(ignored, "pause");
+}
+
+// Final per-command summary across all runs of the script
+void write_batch_summary(std::ostream& out, double elapsed_us) {
+    out << "{\"summary\":{\"runs\":" << g_batch.runs << ",\"lines\":" << g_batch.seq << std::fixed << std::setprecision(1)
+        << ",\"elapsed_us\":" << elapsed_us << ",\"runs_per_second\":" << (elapsed_us > 0 ? g_batch.runs * 1e6 / elapsed_us : 0.0)
+        << ",\"commands\":{";
+    bool first = true;
+    for (const auto& entry : g_batch.timings) {
+        const CommandTiming& t = entry.second;
+        out << (first ? "" : ",") << "\"" << json_escape(entry.first) << "\":{\"count\":" << t.count
+            << ",\"mean_us\":" << t.total_us / t.count << ",\"max_us\":" << t.max_us << ",\"total_us\":" << t.total_us << "}";
+        first = false;
+    }
+    out << "}}}\n";
+    out.flush();
+}
+
+bool load_batch_script(const std::string& path) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (path != "-") {
+        file.open(path);
+        if (!file) return false;
+        in = &file;
+    }
+    std::string line;
+    while (std::getline(*in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        g_batch.script.push_back(line);
+    }
+    return true;
+}
+
+// Discards everything written to it (screen output in batch mode)
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// --- Notes Store ---
+// Notes are appended as raw text to notes.dat; notes.idx2 holds one fixed
+// 40-byte entry per note (learner, lesson key, date, text location). Only the
+// index is read at startup, and only the entries appended since the last
+// refresh are read afterwards, so history is never rescanned. Note text is
+// fetched with pread() one page at a time when it is displayed. The first
+// index, notes.idx, had 16-bit lesson numbers; it is converted once.
+struct NoteIndexEntry {
+    uint64_t learner;   // fnv1a of the learner id
+    int32_t date;       // YYYYMMDD
+    uint8_t lang;
+    uint8_t level;
+    uint16_t reserved;
+    uint32_t lesson;
+    uint32_t length;
+    uint64_t offset;    // into notes.dat
+    uint32_t crc;       // crc32 of the note text
+    uint32_t reserved2;
+};
+static_assert(sizeof(NoteIndexEntry) == 40, "NoteIndexEntry layout is part of the file format");
+
+// An entry of notes.idx, read only to convert it
+struct LegacyNoteIndexEntry {
+    uint64_t learner;
+    int32_t date;
+    uint8_t lang;
+    uint8_t level;
+    uint16_t lesson;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t crc;
+};
+static_assert(sizeof(LegacyNoteIndexEntry) == 32, "LegacyNoteIndexEntry must match notes.idx");
+
+const int kNotesPageSize = 10;
+
+class NotesStore {
+public:
+    NotesStore() {}
+    NotesStore(const NotesStore&) = delete;
+    NotesStore& operator=(const NotesStore&) = delete;
+    ~NotesStore() {
+        if (data_fd_ >= 0) ::close(data_fd_);
+        if (index_fd_ >= 0) ::close(index_fd_);
+    }
+
+    bool open(const std::string& base, std::string* error) {
+        data_fd_ = ::open((base + ".dat").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        index_fd_ = ::open((base + ".idx2").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (data_fd_ < 0 || index_fd_ < 0) {
+            if (error) *error = "cannot open notes store " + base + ": " + std::strerror(errno);
+            return false;
+        }
+        if (flock(index_fd_, LOCK_EX) == 0) {
+            bool converted = convert_legacy_index(base + ".idx");
+            flock(index_fd_, LOCK_UN);
+            if (!converted) {
+                if (error) *error = "cannot convert notes index " + base + ".idx: " + std::strerror(errno);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool is_open() const { return index_fd_ >= 0; }
+    bool empty() { refresh(); return entries_.empty(); }
+
+    // Appends the text, then its index entry, under the index lock
+    bool append(const std::string& learner, int32_t date, int lang, int level, int lesson, const std::string& text) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (flock(index_fd_, LOCK_EX) != 0) return false;
+        struct stat st;
+        bool ok = fstat(data_fd_, &st) == 0;
+        NoteIndexEntry e;
+        std::memset(&e, 0, sizeof(e));
+        e.learner = fnv1a(learner.data(), learner.size());
+        e.date = date;
+        e.lang = (uint8_t)lang;
+        e.level = (uint8_t)level;
+        e.lesson = (uint32_t)lesson;
+        e.offset = ok ? (uint64_t)st.st_size : 0;
+        e.length = (uint32_t)text.size();
+        e.crc = crc32(text.data(), text.size());
+        ok = ok && write_all(data_fd_, text.data(), text.size()) && write_all(index_fd_, &e, sizeof(e));
+        flock(index_fd_, LOCK_UN);
+        return ok;
+    }
+
+    // Entry ids for one lesson, oldest first
+    std::vector<uint32_t> for_lesson(const std::string& learner, int lang, int level, int lesson) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        refresh_locked();
+        auto it = by_lesson_.find(lesson_key(fnv1a(learner.data(), learner.size()), lang, level, lesson));
+        return it == by_lesson_.end() ? std::vector<uint32_t>() : it->second;
+    }
+
+    // Entry ids for a learner ordered by date, oldest first
+    std::vector<uint32_t> by_date(const std::string& learner) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        refresh_locked();
+        auto it = by_date_.find(fnv1a(learner.data(), learner.size()));
+        return it == by_date_.end() ? std::vector<uint32_t>() : it->second;
+    }
+
+    NoteIndexEntry entry(uint32_t id) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return entries_[id];
+    }
+
+    // Reads a single note's text; corrupt records come back empty
+    std::string text(uint32_t id) {
+        NoteIndexEntry e = entry(id);
+        std::string s(e.length, '\0');
+        if (e.length > 0 && (!read_full(data_fd_, &s[0], e.length, e.offset) || crc32(s.data(), s.size()) != e.crc)) return "";
+        return s;
+    }
+
+private:
+    static uint64_t lesson_key(uint64_t learner, int lang, int level, int lesson) {
+        uint32_t parts[3] = {(uint32_t)lang, (uint32_t)level, (uint32_t)lesson};
+        return fnv1a(parts, sizeof(parts), learner);
+    }
+
+    // Copies the entries of a notes.idx into the empty new index, then
+    // renames the old file so no process converts it twice
+    bool convert_legacy_index(const std::string& path) {
+        struct stat st;
+        if (fstat(index_fd_, &st) != 0 || st.st_size != 0) return true;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return errno == ENOENT;
+        struct stat old_st;
+        std::vector<LegacyNoteIndexEntry> old;
+        bool ok = fstat(fd, &old_st) == 0;
+        if (ok) {
+            old.resize((size_t)old_st.st_size / sizeof(LegacyNoteIndexEntry));
+            ok = read_full(fd, old.data(), old.size() * sizeof(LegacyNoteIndexEntry), 0);
+        }
+        ::close(fd);
+        std::vector<NoteIndexEntry> fresh(old.size());
+        for (size_t i = 0; i < old.size(); ++i) {
+            NoteIndexEntry& e = fresh[i];
+            std::memset(&e, 0, sizeof(e));
+            e.learner = old[i].learner;
+            e.date = old[i].date;
+            e.lang = old[i].lang;
+            e.level = old[i].level;
+            e.lesson = old[i].lesson;
+            e.offset = old[i].offset;
+            e.length = old[i].length;
+            e.crc = old[i].crc;
+        }
+        ok = ok && write_all(index_fd_, fresh.data(), fresh.size() * sizeof(NoteIndexEntry)) && fdatasync(index_fd_) == 0;
+        return ok && std::rename(path.c_str(), (path + ".migrated").c_str()) == 0;
+    }
+
+    static bool write_all(int fd, const void* buf, size_t n) {
+        const char* p = static_cast<const char*>(buf);
+        while (n > 0) {
+            ssize_t put = ::write(fd, p, n);
+            if (put < 0 && errno == EINTR) continue;
+            if (put <= 0) return false;
+            p += put;
+            n -= (size_t)put;
+        }
+        return true;
+    }
+
+    void refresh() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        refresh_locked();
+    }
+
+    // Index only the entries appended since the last refresh (by any process)
+    void refresh_locked() {
+        struct stat st;
+        if (fstat(index_fd_, &st) != 0) return;
+        uint64_t known = (uint64_t)entries_.size() * sizeof(NoteIndexEntry);
+        uint64_t count = ((uint64_t)st.st_size - known) / sizeof(NoteIndexEntry);
+        if ((uint64_t)st.st_size <= known || count == 0) return;
+        std::vector<NoteIndexEntry> fresh((size_t)count);
+        if (!read_full(index_fd_, fresh.data(), fresh.size() * sizeof(NoteIndexEntry), known)) return;
+        for (const NoteIndexEntry& e : fresh) {
+            uint32_t id = (uint32_t)entries_.size();
+            entries_.push_back(e);
+            by_lesson_[lesson_key(e.learner, e.lang, e.level, e.lesson)].push_back(id);
+            std::vector<uint32_t>& dated = by_date_[e.learner];
+            // Notes almost always arrive in date order; insert in place otherwise
+            if (dated.empty() || entries_[dated.back()].date <= e.date) {
+                dated.push_back(id);
+            } else {
+                auto pos = std::upper_bound(dated.begin(), dated.end(), e.date,
+                    [this](int32_t d, uint32_t other) { return d < entries_[other].date; });
+                dated.insert(pos, id);
+            }
+        }
+    }
+
+    int data_fd_ = -1;
+    int index_fd_ = -1;
+    std::mutex mutex_;
+    std::vector<NoteIndexEntry> entries_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_lesson_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_date_;
+};
+
+NotesStore g_notes;
+
+// Notes live next to the progress store (progress.db -> notes.dat/notes.idx2)
+std::string notes_base_path() {
+    size_t slash = g_store_path.find_last_of('/');
+    return (slash == std::string::npos) ? "notes" : g_store_path.substr(0, slash + 1) + "notes";
+}
+
+// One-time import of the free-text notes.txt written by older versions
+void migrate_legacy_notes(const std::string& path) {
+    std::ifstream in(path);
+    if (!in || !g_notes.empty()) return;
+    std::string line;
+    while (std::getline(in, line)) {
+        char date[16] = {0};
+        int lang = 0, level = 0, lesson = 0, consumed = 0;
+        if (sscanf(line.c_str(), "%15s | Lang:%d | Level:%d | Lesson:%d | %n", date, &lang, &level, &lesson, &consumed) < 4 || consumed == 0) continue;
+        g_notes.append(g_learner_id, encode_date(date), lang, level, lesson - 1, line.substr(consumed));
+    }
+    in.close();
+    std::rename(path.c_str(), (path + ".migrated").c_str());
+}
+
+// Notes system helpers
+void save_note(int lang, int level, int lesson, const std::string& note) {
+    g_notes.append(current_learner(), encode_date(get_current_date()), lang, level, lesson, note);
+}
+
+// Paged notes view: this lesson only, or all of the learner's notes newest first
+void display_notes(const Localization* loc, int lang, int level, int lesson, bool this_lesson_only) {
+    std::vector<uint32_t> ids = this_lesson_only ? g_notes.for_lesson(current_learner(), lang, level, lesson)
+                                                 : g_notes.by_date(current_learner());
+    if (ids.empty()) {
+        type_text(loc->no_notes, 20);
+        return;
+    }
+    std::reverse(ids.begin(), ids.end());
+    int pages = ((int)ids.size() + kNotesPageSize - 1) / kNotesPageSize;
+    int page = 0;
+    while (true) {
+        type_text(loc->notes_header, 25);
+        type_text("================", 10);
+        int end = std::min((int)ids.size(), (page + 1) * kNotesPageSize);
+        for (int i = page * kNotesPageSize; i < end; ++i) {
+            NoteIndexEntry e = g_notes.entry(ids[i]);
+            std::cout << decode_date(e.date) << " | Lang:" << (int)e.lang << " | Level:" << (int)e.level << " | Lesson:" << (e.lesson + 1) << " | " << g_notes.text(ids[i]) << '\n';
+        }
+        type_text("================", 10);
+        if (pages == 1) return;
+        std::cout << "Page " << (page + 1) << "/" << pages << " - n: next page, p: previous page, Enter: close ";
+        std::string input;
+        if (!read_line(input, "page")) return;
+        if (input == "n" && page < pages - 1) page++;
+        else if (input == "p" && page > 0) page--;
+        else if (input.empty()) return;
+    }
+}
+
+// --- Event Log ---
+// Every graded event is appended as one fixed 16-byte record to the
+// learner's own log (events/<fnv1a of learner id>.log next to the progress
+// store). A single write() of a whole record to an O_APPEND file is never
+// interleaved with another, so sessions in any process can append without
+// locking, and a record torn by a crash is only ever the last one.
+enum class EventKind : uint8_t { ChallengeAnswer = 1, QuizAnswer = 2, Skip = 3, Solution = 4, Hint = 5, Review = 6, CodeRun = 7 };
+
+struct EventRecord {
+    uint32_t time;       // seconds since the epoch
+    uint32_t lesson;
+    uint32_t answer_ms;  // prompt shown to answer entered; answers only
+    uint8_t kind;        // EventKind
+    uint8_t lang;
+    uint8_t level;
+    uint8_t passed;      // answers only
+};
+static_assert(sizeof(EventRecord) == 16, "EventRecord layout is part of the file format");
+
+class EventLog {
+public:
+    EventLog() {}
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+    ~EventLog() { close_all(); }
+
+    bool open(const std::string& dir, std::string* error) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) {
+            if (error) *error = "cannot create event log directory " + dir + ": " + ec.message();
+            return false;
+        }
+        dir_ = dir;
+        return true;
+    }
+
+    bool is_open() const { return !dir_.empty(); }
+
+    void record(const std::string& learner, EventKind kind, int lang, int level, int lesson, bool passed = false, uint32_t answer_ms = 0) {
+        if (!is_open()) return;
+        EventRecord r;
+        r.time = (uint32_t)clock_now();
+        r.lesson = (uint32_t)lesson;
+        r.answer_ms = answer_ms;
+        r.kind = (uint8_t)kind;
+        r.lang = (uint8_t)lang;
+        r.level = (uint8_t)level;
+        r.passed = passed ? 1 : 0;
+        std::lock_guard<std::mutex> guard(mutex_);
+        int fd = fd_for(learner);
+        if (fd < 0) return;
+        ssize_t put;
+        do { put = ::write(fd, &r, sizeof(r)); } while (put < 0 && errno == EINTR);
+    }
+
+    static std::string file_name(const std::string& learner) {
+        char name[24];
+        snprintf(name, sizeof(name), "%016llx.log", (unsigned long long)fnv1a(learner.data(), learner.size()));
+        return name;
+    }
+
+private:
+    // Served learners come and go; descriptors are kept for the busy ones
+    static const size_t kMaxOpenLogs = 256;
+
+    int fd_for(const std::string& learner) {
+        auto it = fds_.find(learner);
+        if (it != fds_.end()) return it->second;
+        if (fds_.size() >= kMaxOpenLogs) close_all();
+        int fd = ::open((dir_ + "/" + file_name(learner)).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0) fds_.emplace(learner, fd);
+        return fd;
+    }
+
+    void close_all() {
+        for (const auto& entry : fds_) ::close(entry.second);
+        fds_.clear();
+    }
+
+    std::string dir_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, int> fds_;
+};
+
+EventLog g_events;
+
+// The event logs live next to the progress store (progress.db -> events/)
+std::string events_dir_path() {
+    size_t slash = g_store_path.find_last_of('/');
+    return (slash == std::string::npos) ? "events" : g_store_path.substr(0, slash + 1) + "events";
+}
+
+void record_event(EventKind kind, int lang, int level, int lesson, bool passed = false, uint32_t answer_ms = 0) {
+    g_events.record(current_learner(), kind, lang, level, lesson, passed, answer_ms);
+}
+
+uint32_t elapsed_ms(std::chrono::steady_clock::time_point since) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// --- Review Schedule ---
+// Spaced repetition (SM-2) over every lesson a learner has been graded on.
+// Each lesson carries an ease factor, an interval in days and a due day: a
+// pass stretches the interval by the ease, a miss starts it over at one day
+// and lowers the ease. Each level's lessons sit in an indexed min-heap on
+// due day, so grading one is O(log n) and picking a quiz or the next due
+// review does not get slower as the catalog grows. Updates are appended to
+// the learner's own file (reviews/<fnv1a of learner id>.log next to the
+// progress store); the latest record for a lesson wins, and the file is
+// rewritten on load once it is mostly superseded records.
+struct ReviewRecord {
+    uint32_t lesson;
+    int32_t due_day;      // days since the epoch on the local calendar
+    uint16_t interval;    // days
+    uint16_t ease;        // SM-2 ease factor x 1000
+    uint8_t lang;
+    uint8_t level;
+    uint8_t repetitions;  // passes in a row
+    uint8_t lapses;
+};
+static_assert(sizeof(ReviewRecord) == 16, "ReviewRecord layout is part of the file format");
+
+const int kReviewEaseStart = 2500;
+const int kReviewEaseMin = 1300;
+const int kReviewIntervalMax = 3650;
+
+// SM-2 answer quality (0-5) from a graded answer
+int review_quality(bool passed, int distance, uint32_t answer_ms) {
+    if (!passed) return 1;
+    if (distance > 0) return 3;
+    return answer_ms < 15000 ? 5 : 4;
+}
+
+void review_grade(ReviewRecord& r, int quality, int64_t today) {
+    if (quality < 3) {
+        r.repetitions = 0;
+        r.interval = 1;
+        if (r.lapses < 255) ++r.lapses;
+    } else {
+        if (r.repetitions < 255) ++r.repetitions;
+        if (r.repetitions == 1) r.interval = 1;
+        else if (r.repetitions == 2) r.interval = 6;
+        else r.interval = (uint16_t)std::min<int64_t>(kReviewIntervalMax, ((int64_t)r.interval * r.ease + 500) / 1000);
+    }
+    int miss = 5 - quality;
+    r.ease = (uint16_t)std::max(kReviewEaseMin, r.ease + 100 - miss * (80 + miss * 20));
+    r.due_day = (int32_t)(today + r.interval);
+}
+
+class ReviewStore {
+public:
+    ReviewStore() {}
+    ReviewStore(const ReviewStore&) = delete;
+    ReviewStore& operator=(const ReviewStore&) = delete;
+
+    bool open(const std::string& dir, std::string* error) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) {
+            if (error) *error = "cannot create review directory " + dir + ": " + ec.message();
+            return false;
+        }
+        dir_ = dir;
+        return true;
+    }
+
+    bool is_open() const { return !dir_.empty(); }
+
+    // The latest record per lesson, compacting the file when it has grown stale
+    std::vector<ReviewRecord> load(const std::string& learner) {
+        std::vector<ReviewRecord> latest;
+        if (!is_open()) return latest;
+        int fd = open_locked(learner, LOCK_EX);
+        if (fd < 0) return latest;
+        struct stat st;
+        std::vector<ReviewRecord> all;
+        if (fstat(fd, &st) == 0) {
+            all.resize((size_t)st.st_size / sizeof(ReviewRecord));
+            if (!read_full(fd, all.data(), all.size() * sizeof(ReviewRecord), 0)) all.clear();
+        }
+        std::unordered_map<uint64_t, size_t> seen;
+        for (const ReviewRecord& r : all) {
+            auto inserted = seen.emplace(review_key(r.lang, r.level, r.lesson), latest.size());
+            if (inserted.second) latest.push_back(r);
+            else latest[inserted.first->second] = r;
+        }
+        if (all.size() > 2 * latest.size() + 64) {
+            std::string path = file_path(learner);
+            std::string tmp = path + ".tmp";
+            int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            bool ok = out >= 0 && write_full(out, latest.data(), latest.size() * sizeof(ReviewRecord), 0) && fdatasync(out) == 0;
+            if (out >= 0) ::close(out);
+            if (!(ok && std::rename(tmp.c_str(), path.c_str()) == 0)) unlink(tmp.c_str());
+        }
+        ::close(fd);
+        return latest;
+    }
+
+    void append(const std::string& learner, const ReviewRecord& r) {
+        if (!is_open()) return;
+        int fd = open_locked(learner, LOCK_SH);
+        if (fd < 0) return;
+        ssize_t put;
+        do { put = ::write(fd, &r, sizeof(r)); } while (put < 0 && errno == EINTR);
+        ::close(fd);
+    }
+
+    static uint64_t review_key(int lang, int level, int lesson) {
+        return (uint64_t)(uint8_t)lang << 40 | (uint64_t)(uint8_t)level << 32 | (uint32_t)lesson;
+    }
+
+private:
+    std::string file_path(const std::string& learner) const {
+        char name[24];
+        snprintf(name, sizeof(name), "%016llx.log", (unsigned long long)fnv1a(learner.data(), learner.size()));
+        return dir_ + "/" + name;
+    }
+
+    // Appends share the lock; a compaction renaming a new file into place
+    // holds it exclusively, and a writer that lost that race reopens
+    int open_locked(const std::string& learner, int op) {
+        std::string path = file_path(learner);
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) return -1;
+            struct stat on_disk, held;
+            if (flock(fd, op) == 0 && stat(path.c_str(), &on_disk) == 0 && fstat(fd, &held) == 0 &&
+                on_disk.st_ino == held.st_ino && on_disk.st_dev == held.st_dev) {
+                return fd;
+            }
+            ::close(fd);
+        }
+        return -1;
+    }
+
+    std::string dir_;
+};
+
+ReviewStore g_reviews;
+
+// The review files live next to the progress store (progress.db -> reviews/)
+std::string reviews_dir_path() {
+    size_t slash = g_store_path.find_last_of('/');
+    return (slash == std::string::npos) ? "reviews" : g_store_path.substr(0, slash + 1) + "reviews";
+}
+
+// One learner's schedule, held by their session
+class ReviewSchedule {
+public:
+    ReviewSchedule() {}
+    ReviewSchedule(const ReviewSchedule&) = delete;
+    ReviewSchedule& operator=(const ReviewSchedule&) = delete;
+
+    void load(const std::string& learner) {
+        learner_ = learner;
+        items_.clear();
+        index_.clear();
+        heaps_.clear();
+        graded_.clear();
+        for (const ReviewRecord& r : g_reviews.load(learner)) insert(r);
+    }
+
+    // Grades a lesson, scheduling it if it is new, and persists the result
+    void grade(int lang, int level, int lesson, int quality, int64_t today) {
+        uint64_t key = ReviewStore::review_key(lang, level, lesson);
+        if (!index_.count(key)) {
+            ReviewRecord r;
+            std::memset(&r, 0, sizeof(r));
+            r.lang = (uint8_t)lang;
+            r.level = (uint8_t)level;
+            r.lesson = (uint32_t)lesson;
+            r.ease = kReviewEaseStart;
+            insert(r);
+        }
+        Item& item = items_[index_[key]];
+        review_grade(item.record, quality, today);
+        std::vector<uint32_t>& heap = heaps_[heap_id(lang, level)];
+        sift_down(heap, sift_up(heap, item.heap_pos));
+        g_reviews.append(learner_, item.record);
+    }
+
+    // Forgets a lesson for this session (it left the catalog); the file keeps it
+    void drop(int lang, int level, int lesson) {
+        auto it = index_.find(ReviewStore::review_key(lang, level, lesson));
+        if (it == index_.end()) return;
+        std::vector<uint32_t>& heap = heaps_[heap_id(lang, level)];
+        uint32_t pos = items_[it->second].heap_pos;
+        index_.erase(it);
+        unmark_graded(heap_id(lang, level), (uint32_t)lesson);
+        heap[pos] = heap.back();
+        items_[heap[pos]].heap_pos = pos;
+        heap.pop_back();
+        if (pos < heap.size()) sift_down(heap, sift_up(heap, pos));
+    }
+
+    // Up to count lessons of a level for a quiz: those due, then lessons
+    // never graded (in order), then those coming due soonest
+    std::vector<int> quiz(int lang, int level, int count, int lesson_count, int64_t today) const {
+        std::vector<int> due, upcoming, picked;
+        auto heap_it = heaps_.find(heap_id(lang, level));
+        if (heap_it != heaps_.end()) {
+            for (uint32_t item : smallest(heap_it->second, (size_t)count)) {
+                const ReviewRecord& r = items_[item].record;
+                if ((int)r.lesson >= lesson_count) continue;
+                (r.due_day <= today ? due : upcoming).push_back((int)r.lesson);
+            }
+        }
+        picked = due;
+        // Step over runs of graded lessons: reads about count entries, not the level
+        auto runs = graded_.find(heap_id(lang, level));
+        std::map<uint32_t, uint32_t>::const_iterator run;
+        if (runs != graded_.end()) run = runs->second.begin();
+        for (uint32_t lesson = 0; lesson < (uint32_t)lesson_count && (int)picked.size() < count;) {
+            if (runs != graded_.end() && run != runs->second.end() && run->first <= lesson) {
+                lesson = std::max(lesson, run->second);
+                ++run;
+                continue;
+            }
+            picked.push_back((int)lesson++);
+        }
+        for (size_t i = 0; i < upcoming.size() && (int)picked.size() < count; ++i) picked.push_back(upcoming[i]);
+        return picked;
+    }
+
+    // The most overdue lesson in any level of a language
+    bool next_due(int lang, int64_t today, int* level, int* lesson) const {
+        const ReviewRecord* best = earliest(lang);
+        if (!best || best->due_day > today) return false;
+        *level = best->level;
+        *lesson = (int)best->lesson;
+        return true;
+    }
+
+    // Day the next review comes due in a language, if any are scheduled
+    bool next_due_day(int lang, int64_t* day) const {
+        const ReviewRecord* best = earliest(lang);
+        if (best) *day = best->due_day;
+        return best != nullptr;
+    }
+
+    // Reviews due by today; visits only the due part of each heap
+    int due_count(int lang, int64_t today) const {
+        int count = 0;
+        for (auto it = heaps_.lower_bound(heap_id(lang, 0)); it != heaps_.end() && it->first <= heap_id(lang, 255); ++it) {
+            const std::vector<uint32_t>& heap = it->second;
+            std::vector<size_t> stack;
+            if (!heap.empty()) stack.push_back(0);
+            while (!stack.empty()) {
+                size_t pos = stack.back();
+                stack.pop_back();
+                if (items_[heap[pos]].record.due_day > today) continue;
+                ++count;
+                if (2 * pos + 1 < heap.size()) stack.push_back(2 * pos + 1);
+                if (2 * pos + 2 < heap.size()) stack.push_back(2 * pos + 2);
+            }
+        }
+        return count;
+    }
+
+private:
+    struct Item {
+        ReviewRecord record;
+        uint32_t heap_pos;
+    };
+
+    static uint32_t heap_id(int lang, int level) { return (uint32_t)(uint8_t)lang << 8 | (uint8_t)level; }
+
+    bool before(uint32_t a, uint32_t b) const {
+        const ReviewRecord& x = items_[a].record;
+        const ReviewRecord& y = items_[b].record;
+        return x.due_day != y.due_day ? x.due_day < y.due_day : x.lesson < y.lesson;
+    }
+
+    void insert(const ReviewRecord& r) {
+        uint32_t item = (uint32_t)items_.size();
+        std::vector<uint32_t>& heap = heaps_[heap_id(r.lang, r.level)];
+        items_.push_back(Item{r, (uint32_t)heap.size()});
+        index_[ReviewStore::review_key(r.lang, r.level, r.lesson)] = item;
+        heap.push_back(item);
+        sift_up(heap, items_[item].heap_pos);
+        mark_graded(heap_id(r.lang, r.level), r.lesson);
+    }
+
+    void mark_graded(uint32_t id, uint32_t lesson) {
+        std::map<uint32_t, uint32_t>& runs = graded_[id];
+        auto next = runs.upper_bound(lesson);
+        if (next != runs.begin()) {
+            auto prev = std::prev(next);
+            if (prev->second > lesson) return;
+            if (prev->second == lesson) {
+                prev->second = lesson + 1;
+                if (next != runs.end() && next->first == lesson + 1) {
+                    prev->second = next->second;
+                    runs.erase(next);
+                }
+                return;
+            }
+        }
+        if (next != runs.end() && next->first == lesson + 1) {
+            uint32_t end = next->second;
+            runs.erase(next);
+            runs[lesson] = end;
+            return;
+        }
+        runs[lesson] = lesson + 1;
+    }
+
+    void unmark_graded(uint32_t id, uint32_t lesson) {
+        std::map<uint32_t, uint32_t>& runs = graded_[id];
+        auto it = runs.upper_bound(lesson);
+        if (it == runs.begin()) return;
+        --it;
+        if (it->second <= lesson) return;
+        uint32_t end = it->second;
+        if (it->first == lesson) runs.erase(it);
+        else it->second = lesson;
+        if (lesson + 1 < end) runs[lesson + 1] = end;
+    }
+
+    void place(std::vector<uint32_t>& heap, size_t pos, uint32_t item) {
+        heap[pos] = item;
+        items_[item].heap_pos = (uint32_t)pos;
+    }
+
+    size_t sift_up(std::vector<uint32_t>& heap, size_t pos) {
+        uint32_t item = heap[pos];
+        while (pos > 0 && before(item, heap[(pos - 1) / 2])) {
+            place(heap, pos, heap[(pos - 1) / 2]);
+            pos = (pos - 1) / 2;
+        }
+        place(heap, pos, item);
+        return pos;
+    }
+
+    void sift_down(std::vector<uint32_t>& heap, size_t pos) {
+        uint32_t item = heap[pos];
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= heap.size()) break;
+            if (child + 1 < heap.size() && before(heap[child + 1], heap[child])) ++child;
+            if (!before(heap[child], item)) break;
+            place(heap, pos, heap[child]);
+            pos = child;
+        }
+        place(heap, pos, item);
+    }
+
+    // The k earliest items of a heap in order, without disturbing it: O(k log k)
+    std::vector<uint32_t> smallest(const std::vector<uint32_t>& heap, size_t k) const {
+        std::vector<uint32_t> out;
+        auto later = [this, &heap](size_t a, size_t b) { return before(heap[b], heap[a]); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> frontier(later);
+        if (!heap.empty()) frontier.push(0);
+        while (!frontier.empty() && out.size() < k) {
+            size_t pos = frontier.top();
+            frontier.pop();
+            out.push_back(heap[pos]);
+            if (2 * pos + 1 < heap.size()) frontier.push(2 * pos + 1);
+            if (2 * pos + 2 < heap.size()) frontier.push(2 * pos + 2);
+        }
+        return out;
+    }
+
+    const ReviewRecord* earliest(int lang) const {
+        const ReviewRecord* best = nullptr;
+        for (auto it = heaps_.lower_bound(heap_id(lang, 0)); it != heaps_.end() && it->first <= heap_id(lang, 255); ++it) {
+            if (it->second.empty()) continue;
+            const ReviewRecord& top = items_[it->second.front()].record;
+            if (!best || top.due_day < best->due_day || (top.due_day == best->due_day && top.level < best->level)) best = &top;
+        }
+        return best;
+    }
+
+    std::string learner_;
+    std::vector<Item> items_;
+    std::unordered_map<uint64_t, uint32_t> index_;   // review_key -> items_
+    std::map<uint32_t, std::vector<uint32_t>> heaps_;  // heap_id -> items_ in heap order
+    // heap_id -> graded lessons as runs, first -> one past the last
+    std::map<uint32_t, std::map<uint32_t, uint32_t>> graded_;
+};
+
+// --- Code Runner ---
+// "run" grades a learner's program by what it prints instead of by the
+// text of an answer. The source is compiled with the local g++ ($LEARN_CXX
+// to override). If it has no main(), it is wrapped in one first. The program
+// runs with no input and no network (its own user and network namespace),
+// under CPU, memory, file size and wall-clock limits. Its stdout is compared
+// with the lesson's expected output, normalized the same way as answers.
+// These limits contain mistakes, not hostile code: the program still runs
+// as this user with the whole filesystem, so served sessions (--serve)
+// cannot use run.
+// Binaries and failed compiles are cached in compile-cache/ next to the
+// progress store, keyed by a hash of the compiler command and the source.
+// Compiles run on a small pool, and a source that is already being
+// compiled is waited on, not compiled again. Processes sharing a store
+// share the cache, so a classroom submitting the same starter code
+// compiles it once.
+const size_t kRunSourceMax = 64 * 1024;
+const size_t kRunOutputMax = 64 * 1024;
+const int kRunTimeoutMs = 5000;
+const int kCompileTimeoutMs = 60000;
+const char* const kCompileFlags[] = {"-std=c++17", "-O1", "-pipe", "-w"};
+
+struct SandboxLimits {
+    rlim_t cpu_seconds;
+    rlim_t memory_bytes;
+    rlim_t file_bytes;
+    bool isolate_network;
+};
+
+struct ProcessResult {
+    bool started = false;
+    bool timed_out = false;
+    bool truncated = false;  // killed for printing too much
+    int status = 0;      // from waitpid
+    std::string output;  // stdout (and stderr if merged), at most kRunOutputMax bytes
+};
+
+// Runs a program in its own process group under limits, collecting its
+// output until it exits or the deadline passes, then kills the whole group
+ProcessResult run_process(const std::vector<std::string>& args, const std::string& dir, const SandboxLimits& limits,
+                          bool merge_stderr, int timeout_ms) {
+    ProcessResult result;
+    std::vector<char*> argv;
+    for (const std::string& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    int out[2];
+    if (pipe(out) != 0) return result;
+    fcntl(out[0], F_SETFD, FD_CLOEXEC);
+    fcntl(out[1], F_SETFD, FD_CLOEXEC);
+    int null_fd = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+    pid_t pid = null_fd >= 0 ? fork() : -1;
+    if (pid == 0) {
+        // Only async-signal-safe calls from here to exec: other threads may hold locks
+        setpgid(0, 0);
+#if defined(__linux__)
+        if (limits.isolate_network && unshare(CLONE_NEWUSER | CLONE_NEWNET) != 0) _exit(126);
+#endif
+        struct rlimit r;
+        // SIGXCPU at the soft limit says why; SIGKILL a second later if ignored
+        r.rlim_cur = limits.cpu_seconds;
+        r.rlim_max = limits.cpu_seconds + 1;
+        setrlimit(RLIMIT_CPU, &r);
+        r.rlim_cur = r.rlim_max = limits.memory_bytes;
+        setrlimit(RLIMIT_AS, &r);
+        r.rlim_cur = r.rlim_max = limits.file_bytes;
+        setrlimit(RLIMIT_FSIZE, &r);
+        r.rlim_cur = r.rlim_max = 0;
+        setrlimit(RLIMIT_CORE, &r);
+        signal(SIGPIPE, SIG_DFL);
+        dup2(null_fd, 0);
+        dup2(out[1], 1);
+        dup2(merge_stderr ? out[1] : null_fd, 2);
+        for (int fd = 3; fd < 1024; ++fd) ::close(fd);
+        if (chdir(dir.c_str()) != 0) _exit(126);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    ::close(out[1]);
+    if (null_fd >= 0) ::close(null_fd);
+    if (pid < 0) {
+        ::close(out[0]);
+        return result;
+    }
+    setpgid(pid, pid);
+    result.started = true;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    auto left_ms = [&deadline] {
+        return (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    };
+    char buf[4096];
+    for (;;) {
+        int left = left_ms();
+        if (left <= 0) {
+            result.timed_out = true;
+            break;
+        }
+        pollfd p{out[0], POLLIN, 0};
+        int ready = poll(&p, 1, left);
+        if (ready <= 0) continue;
+        ssize_t got = ::read(out[0], buf, sizeof(buf));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        result.output.append(buf, std::min((size_t)got, kRunOutputMax - result.output.size()));
+        if (result.output.size() == kRunOutputMax) {
+            result.truncated = true;
+            kill(-pid, SIGKILL);
+            break;
+        }
+    }
+    ::close(out[0]);
+    // A program can close stdout and keep running
+    while (!result.timed_out && waitpid(pid, &result.status, WNOHANG) == 0) {
+        if (left_ms() <= 0) result.timed_out = true;
+        else std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    kill(-pid, SIGKILL);
+    if (result.timed_out) waitpid(pid, &result.status, 0);
+    return result;
+}
+
+struct CompileResult {
+    bool ok = false;
+    bool cached = false;      // found in the cache, not compiled now
+    std::string binary;       // cached executable
+    std::string diagnostics;  // compiler messages, or why nothing was compiled
+};
+
+std::string compiler_command() {
+    const char* cxx = getenv("LEARN_CXX");
+    return (cxx && *cxx) ? cxx : "g++";
+}
+
+class CompileService {
+public:
+    CompileService() {}
+    CompileService(const CompileService&) = delete;
+    CompileService& operator=(const CompileService&) = delete;
+    ~CompileService() { stop(); }
+
+    // Programs run in a directory of their own, so the cache path must be absolute
+    void configure(const std::string& dir) {
+        std::error_code ec;
+        std::filesystem::path path = std::filesystem::absolute(dir, ec);
+        dir_ = ec ? dir : path.lexically_normal().string();
+    }
+
+    const std::string& dir() const { return dir_; }
+
+    // Compile workers to start on first use; the default leaves cores for sessions
+    void set_workers(int count) { worker_count_ = std::max(1, count); }
+
+    // A cached result at once, or the future of a compile queued (or already
+    // running) for the same source and extra flags
+    std::shared_future<CompileResult> submit(const std::string& source, const std::vector<std::string>& flags = {}) {
+        std::string cxx = compiler_command();
+        uint64_t key = fnv1a(cxx.data(), cxx.size());
+        for (const char* flag : kCompileFlags) key = fnv1a(flag, std::strlen(flag) + 1, key);
+        for (const std::string& flag : flags) key = fnv1a(flag.c_str(), flag.size() + 1, key);
+        key = fnv1a(source.data(), source.size(), key);
+        std::string base = cache_base(key);
+        CompileResult cached;
+        if (load_cached(base, cached)) {
+            std::promise<CompileResult> ready;
+            ready.set_value(cached);
+            return ready.get_future().share();
+        }
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto it = in_flight_.find(key);
+        if (it != in_flight_.end()) return it->second.future;
+        Job& job = in_flight_[key];
+        job.future = job.promise.get_future().share();
+        queue_.push_back({key, cxx, flags, source});
+        if (workers_.empty()) {
+            stopping_ = false;
+            int count = worker_count_ ? worker_count_ : std::max(1, std::min(4, (int)std::thread::hardware_concurrency() / 2));
+            for (int i = 0; i < count; ++i) workers_.emplace_back(&CompileService::run, this);
+        }
+        wake_.notify_one();
+        return job.future;
+    }
+
+    // Fails whatever is still queued and stops the workers
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : workers_) t.join();
+        workers_.clear();
+        for (auto& entry : in_flight_) {
+            CompileResult result;
+            result.diagnostics = "compiler stopped";
+            entry.second.promise.set_value(result);
+        }
+        in_flight_.clear();
+        queue_.clear();
+    }
+
+private:
+    struct Request {
+        uint64_t key;
+        std::string cxx;
+        std::vector<std::string> flags;
+        std::string source;
+    };
+
+    struct Job {
+        std::promise<CompileResult> promise;
+        std::shared_future<CompileResult> future;
+    };
+
+    std::string cache_base(uint64_t key) const {
+        char name[24];
+        snprintf(name, sizeof(name), "/%016llx", (unsigned long long)key);
+        return dir_ + name;
+    }
+
+    static bool load_cached(const std::string& base, CompileResult& result) {
+        result.cached = true;
+        if (access((base + ".bin").c_str(), X_OK) == 0) {
+            result.ok = true;
+            result.binary = base + ".bin";
+            return true;
+        }
+        std::ifstream err(base + ".err", std::ios::binary);
+        if (!err) {
+            result.cached = false;
+            return false;
+        }
+        std::stringstream text;
+        text << err.rdbuf();
+        result.diagnostics = text.str();
+        return true;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lk(mutex_);
+        for (;;) {
+            wake_.wait(lk, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            Request request = std::move(queue_.front());
+            queue_.pop_front();
+            lk.unlock();
+            CompileResult result = compile(request);
+            lk.lock();
+            auto it = in_flight_.find(request.key);
+            it->second.promise.set_value(result);
+            in_flight_.erase(it);
+        }
+    }
+
+    CompileResult compile(const Request& request) {
+        CompileResult result;
+        std::string base = cache_base(request.key);
+        // Another process may have compiled it while this one waited
+        if (load_cached(base, result)) return result;
+        // Each compile works in a directory of its own, so diagnostics
+        // name program.cpp and do not depend on who compiled it
+        std::string tmp = base + "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::string work = tmp + ".d";
+        std::error_code ec;
+        std::filesystem::create_directories(work, ec);
+        {
+            std::ofstream src(work + "/program.cpp", std::ios::binary | std::ios::trunc);
+            src << request.source;
+            if (!src) {
+                result.diagnostics = "cannot write " + work + "/program.cpp";
+                std::filesystem::remove_all(work, ec);
+                return result;
+            }
+        }
+        std::vector<std::string> args{request.cxx};
+        args.insert(args.end(), std::begin(kCompileFlags), std::end(kCompileFlags));
+        args.insert(args.end(), request.flags.begin(), request.flags.end());
+        args.insert(args.end(), {"-o", tmp + ".bin", "program.cpp"});
+        SandboxLimits limits{60, (rlim_t)2 << 30, (rlim_t)256 << 20, false};
+        ProcessResult compiled = run_process(args, work, limits, true, kCompileTimeoutMs);
+        std::filesystem::remove_all(work, ec);
+        bool exited = compiled.started && !compiled.timed_out && WIFEXITED(compiled.status);
+        if (exited && WEXITSTATUS(compiled.status) == 0 && std::rename((tmp + ".bin").c_str(), (base + ".bin").c_str()) == 0) {
+            result.ok = true;
+            result.binary = base + ".bin";
+            return result;
+        }
+        unlink((tmp + ".bin").c_str());
+        // A compiler stopped for printing too much failed on the source
+        if (!compiled.truncated && (!exited || WEXITSTATUS(compiled.status) >= 126)) {
+            // Nothing wrong with the source; do not cache
+            result.diagnostics = compiled.timed_out ? "compiler timed out" : "cannot run " + request.cxx;
+            return result;
+        }
+        result.diagnostics = compiled.output;
+        if (compiled.truncated) result.diagnostics += "\n[... more diagnostics cut off at " + std::to_string(kRunOutputMax / 1024) + " KiB]\n";
+        std::ofstream err(tmp + ".err", std::ios::binary | std::ios::trunc);
+        err << result.diagnostics;
+        err.close();
+        if (!err || std::rename((tmp + ".err").c_str(), (base + ".err").c_str()) != 0) unlink((tmp + ".err").c_str());
+        return result;
+    }
+
+    std::string dir_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Request> queue_;
+    std::unordered_map<uint64_t, Job> in_flight_;
+    std::vector<std::thread> workers_;
+    int worker_count_ = 0;
+    bool stopping_ = false;
+};
+
+CompileService g_compiler;
+
+// The compile cache lives next to the progress store (progress.db -> compile-cache/)
+std::string compile_cache_dir_path() {
+    size_t slash = g_store_path.find_last_of('/');
+    return (slash == std::string::npos) ? "compile-cache" : g_store_path.substr(0, slash + 1) + "compile-cache";
+}
+
+// What a lesson-style snippet is compiled against
+const char kProgramPrelude[] =
+    "#include <iostream>\n#include <string>\n#include <vector>\n#include <map>\n#include <algorithm>\n"
+    "#include <memory>\n#include <stdexcept>\nusing namespace std;\n";
+
+// A main identifier followed by "(", not a call like domain(x) or obj.main()
+bool has_main(const std::string& code) {
+    auto ident = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+    for (size_t at = code.find("main"); at != std::string::npos; at = code.find("main", at + 1)) {
+        if (at > 0 && (ident(code[at - 1]) || code[at - 1] == '.' || code[at - 1] == '>' || code[at - 1] == ':')) continue;
+        size_t next = code.find_first_not_of(" \t\r\n", at + 4);
+        if (next != std::string::npos && code[next] == '(') return true;
+    }
+    return false;
+}
+
+// Statements wrapped in main(), numbered from the snippet's first line.
+// Preprocessor lines (#include) move above main(), leaving blank lines behind.
+std::string main_wrapped(const std::string& code) {
+    std::string directives = "#line 1 \"program.cpp\"\n", body;
+    std::istringstream lines(code);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t text = line.find_first_not_of(" \t");
+        bool directive = text != std::string::npos && line[text] == '#';
+        directives += directive ? line : std::string();
+        directives += '\n';
+        body += directive ? std::string() : line;
+        body += '\n';
+    }
+    return directives + "int main() {\n#line 1 \"program.cpp\"\n" + body + "return 0;\n}\n";
+}
+
+// Lesson-style snippets get the usual headers and a main() around them
+std::string program_source(const std::string& code) {
+    if (has_main(code)) return code;
+    return kProgramPrelude + main_wrapped(code);
+}
+
+struct RunReport {
+    bool compiled = false;
+    bool finished = false;  // ran to a normal exit within its limits
+    bool passed = false;
+    std::string diagnostics;
+    std::string output;
+};
+
+// Runs a compiled program in the sandbox and checks what it prints
+void run_program(const std::string& binary, std::string_view expected, RunReport& report) {
+    report.compiled = true;
+    char dir[] = "/tmp/learn-run-XXXXXX";
+    if (!mkdtemp(dir)) {
+        report.diagnostics = std::string("cannot make a run directory: ") + std::strerror(errno);
+        return;
+    }
+    SandboxLimits limits{2, (rlim_t)256 << 20, (rlim_t)1 << 20, true};
+    ProcessResult run = run_process({binary}, dir, limits, false, kRunTimeoutMs);
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    report.output = run.output;
+    if (!run.started) report.diagnostics = "could not be started";
+    else if (run.truncated) report.diagnostics = "printed more than " + std::to_string(kRunOutputMax / 1024) + " KiB";
+    else if (run.timed_out) report.diagnostics = "was stopped after " + std::to_string(kRunTimeoutMs / 1000) + " s";
+    else if (WIFSIGNALED(run.status)) report.diagnostics = std::string("was killed: ") + strsignal(WTERMSIG(run.status));
+    else if (WEXITSTATUS(run.status) == 126) report.diagnostics = "could not be started in its sandbox";
+    else if (WEXITSTATUS(run.status) != 0) report.diagnostics = "exited with status " + std::to_string(WEXITSTATUS(run.status));
+    else report.finished = true;
+    std::u32string got, want;
+    normalize_answer(run.output, got);
+    normalize_answer(expected, want);
+    report.passed = report.finished && got == want;
+}
+
+RunReport run_learner_code(const std::string& code, std::string_view expected) {
+    RunReport report;
+    CompileResult build = g_compiler.submit(program_source(code)).get();
+    if (!build.ok) report.diagnostics = build.diagnostics;
+    else run_program(build.binary, expected, report);
+    return report;
+}
+
+// Automatic backup helper: the snapshot is taken in the background
+void create_backup() {
+    g_snapshots.request(g_progress_store);
+}
+
+// Weekly statistics helper
+void display_weekly_stats(int weekly_lessons, int weekly_xp, int weekly_sessions) {
+    type_text("\033[1;36m📊 Weekly Statistics Summary\033[0m", 25);
+    type_text("================", 10);
+    type_text("✅ Total Lessons Completed: " + std::to_string(weekly_lessons), 20);
+    type_text("🎯 Total XP: " + std::to_string(weekly_xp), 20);
+    type_text("📅 Number of Sessions: " + std::to_string(weekly_sessions), 20);
+    if (weekly_sessions > 0) {
+        double avg_lessons = (double)weekly_lessons / weekly_sessions;
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << avg_lessons;
+        type_text("📈 Average Lessons Per Session: " + ss.str(), 20);
+    }
+    type_text("================", 10);
+}
+
+// --- Instructor Overlay ---
+// Instructor edits never touch the base catalog (built-in or pack). Each
+// saved edit is one version in an append-only log (lessons.overlay in the
+// pack directory) holding the changed fields of one lesson. Rolling back
+// appends a record naming the version to return to, so any version can be
+// restored and nothing is rewritten. At load the effective versions become
+// per-lesson LessonPatch entries that lesson_view() lays over the base
+// lesson; unedited lessons keep reading the base storage.
+//
+// Record: magic | payload size | payload | crc32(payload)
+// Payload: version u32, op u8, time i64, then for an edit: lang u8,
+// level u16, lesson u32, field count u8, (field u8, length u32, text)*;
+// for a rollback: target version u32.
+const uint32_t kOverlayMagic = 0x314F564Cu;  // "LVO1"
+const uint8_t kOverlayEdit = 1;
+const uint8_t kOverlayRollback = 2;
+
+struct OverlayVersion {
+    uint32_t version = 0;
+    uint8_t op = 0;
+    int64_t time = 0;
+    uint8_t lang = 0;
+    uint16_t level = 0;
+    uint32_t lesson = 0;
+    uint32_t target = 0;  // rollback only
+    std::vector<std::pair<uint8_t, std::string>> fields;
+};
+
+class CatalogOverlay {
+public:
+    CatalogOverlay() {}
+    CatalogOverlay(const CatalogOverlay&) = delete;
+    CatalogOverlay& operator=(const CatalogOverlay&) = delete;
+    ~CatalogOverlay() { if (fd_ >= 0) ::close(fd_); }
+
+    bool open(const std::string& path, std::string* error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            if (error) *error = "cannot open instructor overlay " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        if (flock(fd_, LOCK_EX) != 0) return true;
+        refresh_locked();
+        flock(fd_, LOCK_UN);
+        return true;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Picks up versions saved by other processes
+    void refresh() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0 || flock(fd_, LOCK_EX) != 0) return;
+        refresh_locked();
+        flock(fd_, LOCK_UN);
+    }
+
+    std::vector<OverlayVersion> history() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return versions_;
+    }
+
+    // Indexes into history() of the edits in effect, oldest first
+    std::vector<size_t> effective() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return effective_locked();
+    }
+
+    // Rebuild a catalog's patches for one language from the effective edits
+    void apply(int lang, Localization& loc) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loc.patches.clear();
+        for (size_t i : effective_locked()) {
+            const OverlayVersion& v = versions_[i];
+            if (v.lang != lang) continue;
+            LessonPatch& patch = loc.patches[patch_key(v.level, (int)v.lesson)];
+            for (const auto& field : v.fields) {
+                patch.mask |= (uint8_t)(1u << field.first);
+                patch.fields[field.first] = InternedText::intern(field.second);
+            }
+        }
+    }
+
+    // Saves the fields as a new version; returns its number, 0 on failure
+    uint32_t commit(int lang, int level, int lesson, const std::vector<std::pair<uint8_t, std::string>>& fields, std::string* error) {
+        OverlayVersion v;
+        v.op = kOverlayEdit;
+        v.lang = (uint8_t)lang;
+        v.level = (uint16_t)level;
+        v.lesson = (uint32_t)lesson;
+        v.fields = fields;
+        return append(v, error);
+    }
+
+    uint32_t rollback(uint32_t target, std::string* error) {
+        OverlayVersion v;
+        v.op = kOverlayRollback;
+        v.target = target;
+        return append(v, error);
+    }
+
+    // Undoes the newest version in the log, whatever it was: a rollback to
+    // the version before it. target receives that version.
+    uint32_t undo(uint32_t* target, std::string* error) {
+        OverlayVersion v;
+        v.op = kOverlayRollback;
+        uint32_t version = append(v, error, true);
+        if (version != 0) *target = v.target;
+        return version;
+    }
+
+private:
+    // The state at a version is the state before it plus its edit, or for a
+    // rollback the state at its target. States share their tails: top[i] is
+    // the newest edit in effect at versions_[i] and below[] links each edit
+    // to the one in effect before it, so later versions stay reachable.
+    std::vector<size_t> effective_locked() const {
+        const size_t kNone = (size_t)-1;
+        std::vector<size_t> top(versions_.size(), kNone), below(versions_.size(), kNone);
+        for (size_t i = 0; i < versions_.size(); ++i) {
+            const OverlayVersion& v = versions_[i];
+            if (v.op == kOverlayEdit) {
+                below[i] = i > 0 ? top[i - 1] : kNone;
+                top[i] = i;
+            } else {
+                // A target past the rollback itself restores nothing
+                size_t at = version_index_locked(v.target);
+                if (at == kNone) top[i] = kNone;
+                else top[i] = at < i ? top[at] : (i > 0 ? top[i - 1] : kNone);
+            }
+        }
+        std::vector<size_t> chain;
+        for (size_t i = versions_.empty() ? kNone : top.back(); i != kNone; i = below[i]) chain.push_back(i);
+        std::reverse(chain.begin(), chain.end());
+        return chain;
+    }
+
+    // Versions are numbered from 1 in log order; (size_t)-1 for version 0
+    size_t version_index_locked(uint32_t version) const {
+        if (version == 0 || versions_.empty()) return (size_t)-1;
+        size_t i = std::min((size_t)version, versions_.size()) - 1;
+        while (i > 0 && versions_[i].version > version) --i;
+        return versions_[i].version == version ? i : (size_t)-1;
+    }
+
+    uint32_t append(OverlayVersion& v, std::string* error, bool undo_latest = false) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0 || flock(fd_, LOCK_EX) != 0) {
+            if (error) *error = "instructor overlay is not open";
+            return 0;
+        }
+        // Another process may have saved versions since we last looked
+        refresh_locked();
+        uint32_t latest = versions_.empty() ? 0 : versions_.back().version;
+        if (undo_latest && latest == 0) {
+            if (error) *error = "nothing to undo";
+            flock(fd_, LOCK_UN);
+            return 0;
+        }
+        if (undo_latest) v.target = latest - 1;
+        if (v.op == kOverlayRollback && v.target > latest) {
+            if (error) *error = "there is no version " + std::to_string(v.target) + " (latest is " + std::to_string(latest) + ")";
+            flock(fd_, LOCK_UN);
+            return 0;
+        }
+        v.version = latest + 1;
+        v.time = clock_now();
+        std::string payload;
+        auto put = [&payload](const void* p, size_t n) { payload.append((const char*)p, n); };
+        put(&v.version, 4);
+        put(&v.op, 1);
+        put(&v.time, 8);
+        if (v.op == kOverlayEdit) {
+            uint8_t count = (uint8_t)v.fields.size();
+            put(&v.lang, 1);
+            put(&v.level, 2);
+            put(&v.lesson, 4);
+            put(&count, 1);
+            for (const auto& field : v.fields) {
+                uint32_t length = (uint32_t)field.second.size();
+                put(&field.first, 1);
+                put(&length, 4);
+                put(field.second.data(), length);
+            }
+        } else {
+            put(&v.target, 4);
+        }
+        uint32_t size = (uint32_t)payload.size();
+        uint32_t crc = crc32(payload.data(), payload.size());
+        std::string record;
+        record.append((const char*)&kOverlayMagic, 4);
+        record.append((const char*)&size, 4);
+        record += payload;
+        record.append((const char*)&crc, 4);
+        bool written = write_full(fd_, record.data(), record.size(), offset_) && fdatasync(fd_) == 0;
+        if (written) {
+            offset_ += record.size();
+            versions_.push_back(v);
+        } else if (error) {
+            *error = std::string("cannot write instructor overlay: ") + std::strerror(errno);
+        }
+        flock(fd_, LOCK_UN);
+        return written ? v.version : 0;
+    }
+
+    // Read records appended since the last look; a torn tail is cut off
+    void refresh_locked() {
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || (uint64_t)st.st_size <= offset_) return;
+        std::vector<char> buf((size_t)(st.st_size - offset_));
+        if (!read_full(fd_, buf.data(), buf.size(), offset_)) return;
+        size_t pos = 0;
+        while (pos + 12 <= buf.size()) {
+            uint32_t magic, size, crc;
+            std::memcpy(&magic, &buf[pos], 4);
+            std::memcpy(&size, &buf[pos + 4], 4);
+            if (magic != kOverlayMagic || pos + 12 + size > buf.size()) break;
+            std::memcpy(&crc, &buf[pos + 8 + size], 4);
+            OverlayVersion v;
+            if (crc != crc32(&buf[pos + 8], size) || !decode(&buf[pos + 8], size, v)) break;
+            versions_.push_back(std::move(v));
+            pos += 12 + size;
+        }
+        offset_ += pos;
+        if (offset_ < (uint64_t)st.st_size) ftruncate(fd_, (off_t)offset_);
+    }
+
+    static bool decode(const char* p, size_t n, OverlayVersion& v) {
+        const char* end = p + n;
+        auto get = [&p, end](void* out, size_t k) {
+            if ((size_t)(end - p) < k) return false;
+            std::memcpy(out, p, k);
+            p += k;
+            return true;
+        };
+        if (!get(&v.version, 4) || !get(&v.op, 1) || !get(&v.time, 8)) return false;
+        if (v.op == kOverlayRollback) return get(&v.target, 4);
+        uint8_t count;
+        if (v.op != kOverlayEdit || !get(&v.lang, 1) || !get(&v.level, 2) || !get(&v.lesson, 4) || !get(&count, 1)) return false;
+        for (uint8_t i = 0; i < count; ++i) {
+            uint8_t field;
+            uint32_t length;
+            if (!get(&field, 1) || !get(&length, 4) || field >= kLessonFieldCount || (size_t)(end - p) < length) return false;
+            v.fields.emplace_back(field, std::string(p, length));
+            p += length;
+        }
+        return true;
+    }
+
+    mutable std::mutex mutex_;  // catalog rebuilds refresh from another thread
+    int fd_ = -1;
+    uint64_t offset_ = 0;
+    std::vector<OverlayVersion> versions_;
+};
+
+CatalogOverlay g_overlay;
+
+// Called by build_catalog() for every catalog it builds
+void apply_instructor_overlay(int lang, Localization& loc) {
+    static bool opened = false;
+    if (!opened) {
+        opened = true;
+        std::string error;
+        if (!g_overlay.open(g_pack_dir + "/lessons.overlay", &error)) std::cerr << error << std::endl;
+    } else {
+        g_overlay.refresh();
+    }
+    if (g_overlay.is_open()) g_overlay.apply(lang, loc);
+}
+
+std::string overlay_time(int64_t t) {
+    time_t tt = (time_t)t;
+    tm local;
+    char buf[20];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", localtime_r(&tt, &local));
+    return buf;
+}
+
+void show_overlay_history() {
+    std::vector<OverlayVersion> all = g_overlay.history();
+    std::vector<size_t> live = g_overlay.effective();
+    if (all.empty()) { std::cout << "No saved edits yet.\n"; return; }
+    size_t first = all.size() > 15 ? all.size() - 15 : 0;
+    for (size_t i = first; i < all.size(); ++i) {
+        const OverlayVersion& v = all[i];
+        std::cout << (std::find(live.begin(), live.end(), i) != live.end() ? "* " : "  ")
+                  << "v" << v.version << "  " << overlay_time(v.time) << "  ";
+        if (v.op == kOverlayRollback) {
+            std::cout << "rollback to v" << v.target << '\n';
+            continue;
+        }
+        std::cout << locale_code(v.lang) << " level " << (v.level + 1) << " lesson " << (v.lesson + 1) << ":";
+        for (size_t f = 0; f < v.fields.size(); ++f) std::cout << (f ? ", " : " ") << kLessonFieldNames[v.fields[f].first];
+        std::cout << '\n';
+    }
+    std::cout << "(* = in effect)\n";
+}
+
+bool reload_catalog(int lang, std::string* error);
+
+// Instructor mode helper: edit any fields of the current lesson, then save
+// them as one overlay version; also history, undo and rollback
+bool instructor_mode_edit(Localization* loc, int lang, int level, int lesson) {
+    if (t_session) {
+        // Served sessions share one catalog; edits would race other learners
+        std::cout << "\033[31mEditing lessons is not available in a shared session.\033[0m\n";
+        return false;
+    }
+    type_text("\033[1;33m" + loc->instructor_mode + "\033[0m", 25);
+    std::cout << loc->instructor_password;
+    std::string password;
+    read_line(password, "instructor");
+    
+    if (password != "instructor123") {
+        type_text("\033[31m❌ Incorrect password!\033[0m", 20);
+        return false;
+    }
+    
+    type_text("\033[32m✅ Access granted!\033[0m", 20);
+    std::vector<std::pair<uint8_t, std::string>> pending;
+    while (true) {
+        type_text("What would you like to edit?", 20);
+        for (int f = 0; f < 6; ++f) type_text(std::to_string(f + 1) + ") " + kLessonFieldNames[f], 15);
+        type_text("7) Save changes" + (pending.empty() ? std::string() : " (" + std::to_string(pending.size()) + " pending)"), 15);
+        type_text("8) History", 15);
+        type_text("9) Undo last saved version", 15);
+        type_text("10) Roll back to a version", 15);
+        type_text("0) Cancel", 15);
+        std::string choice;
+        if (!read_line(choice, "instructor") || choice == "0") return false;
+        int picked = atoi(choice.c_str());
+        std::string error;
+        if (picked >= 1 && picked <= 6) {
+            type_text("Enter new content:", 20);
+            std::string new_content;
+            read_line(new_content, "instructor");
+            uint8_t field = (uint8_t)(picked - 1);
+            auto same = std::find_if(pending.begin(), pending.end(), [field](const std::pair<uint8_t, std::string>& p) { return p.first == field; });
+            if (same != pending.end()) same->second = new_content;
+            else pending.emplace_back(field, new_content);
+        } else if (picked == 7) {
+            if (pending.empty()) { type_text("Nothing to save.", 15); continue; }
+            uint32_t version = g_overlay.commit(lang, level, lesson, pending, &error);
+            if (version == 0) {
+                type_text("\033[31m❌ " + error + "\033[0m", 20);
+                return false;
+            }
+            // The session picks the rebuilt catalog up before its next command
+            if (!reload_catalog(lang, &error)) type_text("\033[31m❌ " + error + "\033[0m", 20);
+            type_text("\033[32m✅ Content updated! Saved as version " + std::to_string(version) + "\033[0m", 20);
+            return true;
+        } else if (picked == 8) {
+            show_overlay_history();
+        } else if (picked == 9 || picked == 10) {
+            uint32_t target = 0, version = 0;
+            if (picked == 9) {
+                version = g_overlay.undo(&target, &error);
+            } else {
+                std::cout << "Roll back to version (0 = the original catalog): ";
+                std::string input;
+                read_line(input, "instructor");
+                target = (uint32_t)std::max(0, atoi(input.c_str()));
+                version = g_overlay.rollback(target, &error);
+            }
+            if (version == 0) {
+                type_text("\033[31m❌ " + error + "\033[0m", 20);
+                continue;
+            }
+            // A rollback can touch lessons of any language
+            for (const LocaleInfo& info : kLocales) {
+                if (!reload_catalog(info.id, &error)) type_text("\033[31m❌ " + error + "\033[0m", 20);
+            }
+            type_text("\033[32m✅ Rolled back to version " + std::to_string(target) + " (recorded as version " + std::to_string(version) + ")\033[0m", 20);
+            return true;
+        }
+    }
+}
+
+// Smart reminder helper
+void show_reminder(const std::string& last_seen_date, Localization* loc) {
+    std::string today = get_current_date();
+    int days = days_between(last_seen_date, today);
+    if (days > 2) {
+        std::string message = loc->reminder_message;
+        size_t pos = message.find("{days}");
+        if (pos != std::string::npos) {
+            message.replace(pos, 6, std::to_string(days));
+        }
+        std::cout << "\033[1;33m" << message << "\033[0m\n";
+        std::cout << "Press Enter to continue...";
+        g_calendar.reminders++;
+        wait_for_enter();
+    }
+}
+
+// End-of-level quiz: the level's due reviews first, then lessons not yet
+// graded. A retake draws a fresh set from the updated schedule.
+void run_end_of_level_quiz(const Localization& loc, int lang, int level, ReviewSchedule& reviews, int& xp, int& total_xp) {
+    for (;;) {
+        clear_screen();
+        type_text("\033[1;36m===== End-of-Level Quiz =====\033[0m", 25);
+        int64_t today = local_day(clock_now());
+        std::vector<int> lessons = reviews.quiz(lang, level, 5, level_lesson_count(loc, level), today);
+        int num_questions = (int)lessons.size();
+        int correct = 0;
+        for (int i = 0; i < num_questions; ++i) {
+            int lesson = lessons[i];
+            LessonView q = lesson_view(loc, level, lesson);
+            type_text("Q" + std::to_string(i+1) + ": " + std::string(q.challenge), 20);
+            std::cout << "Your answer: ";
+            std::string answer;
+            auto asked = std::chrono::steady_clock::now();
+            // A hangup is not a wrong answer: leave the rest ungraded
+            if (!read_line(answer, "answer")) return;
+            std::string correct_ans(q.solution);
+            int distance = 0;
+            bool passed = answer_key(loc, level, lesson).accepts(answer, &distance);
+            uint32_t answer_ms = elapsed_ms(asked);
+            record_event(EventKind::QuizAnswer, lang, level, lesson, passed, answer_ms);
+            reviews.grade(lang, level, lesson, review_quality(passed, distance, answer_ms), today);
+            if (passed) {
+                if (distance > 0) type_text("\033[32mCorrect!\033[0m (close enough: " + correct_ans + ")", 15);
+                else type_text("\033[32mCorrect!\033[0m", 15);
+                ++correct;
+                xp += 5;
+                total_xp += 5;
+            } else {
+                type_text("\033[31mIncorrect.\033[0m Solution: " + correct_ans, 20);
+            }
+        }
+        type_text("\n\033[1;36mFinal Score: " + std::to_string(correct) + "/" + std::to_string(num_questions) + "\033[0m", 25);
+        if (correct == num_questions) type_text("\033[32mGreat job!\033[0m", 20);
+        else if (correct >= num_questions/2) type_text("\033[33mGood effort!\033[0m", 20);
+        else type_text("\033[31mKeep practicing!\033[0m", 20);
+        std::cout << "\nType retry to retake the quiz, or press Enter to continue: ";
+        std::string retry;
+        read_line(retry, "select");
+        if (retry != "retry") return;
+    }
+}
+
+const int kDailyReviewLimit = 20;
+
+// Daily review: lessons due in every level of the language, most overdue
+// first. A miss comes due again tomorrow, so one sitting never loops.
+void run_daily_review(const Localization& loc, int lang, ReviewSchedule& reviews, int& xp, int& total_xp) {
+    clear_screen();
+    type_text("\033[1;36m===== Daily Review =====\033[0m", 25);
+    int64_t today = local_day(clock_now());
+    int asked = 0, correct = 0;
+    int level = 0, lesson = 0;
+    while (asked < kDailyReviewLimit && reviews.next_due(lang, today, &level, &lesson)) {
+        if (level >= level_count(loc) || lesson >= level_lesson_count(loc, level)) {
+            reviews.drop(lang, level, lesson);
+            continue;
+        }
+        LessonView q = lesson_view(loc, level, lesson);
+        type_text("R" + std::to_string(asked + 1) + " (" + loc.levels[level].name + "): " + std::string(q.challenge), 20);
+        std::cout << "Your answer (or exit): ";
+        std::string answer;
+        auto shown = std::chrono::steady_clock::now();
+        if (!read_line(answer, "answer") || answer == "exit") break;
+        ++asked;
+        std::string correct_ans(q.solution);
+        int distance = 0;
+        bool passed = answer_key(loc, level, lesson).accepts(answer, &distance);
+        uint32_t answer_ms = elapsed_ms(shown);
+        record_event(EventKind::Review, lang, level, lesson, passed, answer_ms);
+        reviews.grade(lang, level, lesson, review_quality(passed, distance, answer_ms), today);
+        if (passed) {
+            if (distance > 0) type_text("\033[32mCorrect!\033[0m (close enough: " + correct_ans + ")", 15);
+            else type_text("\033[32mCorrect!\033[0m", 15);
+            ++correct;
+            xp += 5;
+            total_xp += 5;
+        } else {
+            type_text("\033[31mIncorrect.\033[0m Solution: " + correct_ans, 20);
+        }
+    }
+    if (asked == 0) std::cout << "Nothing is due for review today.\n";
+    else type_text("\n\033[1;36mReviewed: " + std::to_string(correct) + "/" + std::to_string(asked) + " correct\033[0m", 25);
+    int64_t next = 0;
+    if (reviews.next_due_day(lang, &next)) std::cout << "Next review due: " << format_date(next) << '\n';
+    std::cout << "Press Enter to continue...";
+    wait_for_enter();
+}
+
+// --- Lesson Import ---
+// A lesson file is 7 lines: title, explanation, code, challenge, solution,
+// expected output, hint. import-dir walks a directory tree, parses and
+// validates every file on a pool of threads, drops lessons whose content is
+// already in the level (or earlier in the batch), and appends the rest in
+// one step.
+const char* const kLessonFileLines[] = {"title", "explanation", "code", "challenge", "solution", "output", "hint"};
+const uintmax_t kLessonFileMax = 1 << 20;
+
+bool parse_lesson_file(const std::string& filename, Lesson& lesson, std::string* error) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(filename, ec);
+    if (!ec && size > kLessonFileMax) {
+        if (error) *error = "larger than " + std::to_string(kLessonFileMax) + " bytes";
+        return false;
+    }
+    std::ifstream in(filename);
+    if (!in) {
+        if (error) *error = "cannot open";
+        return false;
+    }
+    std::string lines[7];
+    int count = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (count < 7) {
+            lines[count++] = std::move(line);
+        } else if (line.find_first_not_of(" \t") != std::string::npos) {
+            if (error) *error = "unexpected text after line 7";
+            return false;
+        }
+    }
+    if (count < 7) {
+        if (error) *error = "expected 7 lines (title, explanation, code, challenge, solution, output, hint), found " + std::to_string(count);
+        return false;
+    }
+    for (int required : {0, 3, 4}) {
+        if (lines[required].find_first_not_of(" \t") == std::string::npos) {
+            if (error) *error = "line " + std::to_string(required + 1) + " (" + kLessonFileLines[required] + ") is empty";
+            return false;
+        }
+    }
+    lesson = Lesson();
+    lesson.explanation = InternedText::intern(lines[0] + "\n" + lines[1]);
+    lesson.code = InternedText::intern(lines[2]);
+    lesson.challenge = InternedText::intern(lines[3]);
+    lesson.solution = InternedText::intern(lines[4]);
+    lesson.expected_output = InternedText::intern(lines[5]);
+    lesson.hint = InternedText::intern(lines[6]);
+    return true;
+}
+
+// Identity of a lesson's content, for deduplication
+uint64_t lesson_content_hash(const Lesson& l) {
+    uint64_t h = 14695981039346656037ull;
+    for (int f = 0; f < kLessonFieldCount; ++f) {
+        std::string_view field = l.*kLessonFields[f];
+        h = fnv1a(field.data(), field.size(), h);
+        h = fnv1a("\0", 1, h);
+    }
+    return h;
+}
+
+// Helper to import lesson from file
+bool import_lesson(const std::string& filename, Level& level, std::string* error) {
+    Lesson l;
+    if (!parse_lesson_file(filename, l, error)) return false;
+    level.lessons.push_back(std::move(l));
+    return true;
+}
+
+struct ImportReport {
+    size_t files = 0;
+    size_t imported = 0;
+    size_t duplicates = 0;
+    std::vector<std::pair<std::string, std::string>> errors;  // file, reason
+};
+
+ImportReport import_lesson_dir(const std::string& dir, Level& level) {
+    ImportReport report;
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (!name.empty() && name[0] == '.') {
+            if (it->is_directory(ec)) it.disable_recursion_pending();
+            continue;
+        }
+        if (it->is_regular_file(ec)) files.push_back(it->path().string());
+    }
+    if (ec) report.errors.emplace_back(dir, ec.message());
+    // Sorted, so which of two duplicates wins does not depend on the walk order
+    std::sort(files.begin(), files.end());
+    report.files = files.size();
+
+    struct Parsed {
+        Lesson lesson;
+        std::string error;
+        uint64_t hash = 0;
+        bool ok = false;
+    };
+    std::vector<Parsed> parsed(files.size());
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            Parsed& p = parsed[i];
+            p.ok = parse_lesson_file(files[i], p.lesson, &p.error);
+            if (p.ok) p.hash = lesson_content_hash(p.lesson);
+        }
+    };
+    size_t thread_count = std::min<size_t>(files.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < thread_count; ++t) pool.emplace_back(work);
+    work();
+    for (std::thread& t : pool) t.join();
+
+    std::unordered_map<uint64_t, bool> seen;
+    for (const Lesson& l : level.lessons) seen[lesson_content_hash(l)] = true;
+    std::vector<Lesson*> accepted;
+    for (size_t i = 0; i < parsed.size(); ++i) {
+        if (!parsed[i].ok) { report.errors.emplace_back(files[i], parsed[i].error); continue; }
+        if (!seen.emplace(parsed[i].hash, true).second) { ++report.duplicates; continue; }
+        accepted.push_back(&parsed[i].lesson);
+    }
+    level.lessons.reserve(level.lessons.size() + accepted.size());
+    for (Lesson* l : accepted) level.lessons.push_back(std::move(*l));
+    report.imported = accepted.size();
+    return report;
+}
+
+void print_import_report(const ImportReport& report, std::ostream& out) {
+    for (const auto& e : report.errors) out << "\033[31m" << e.first << ": " << e.second << "\033[0m\n";
+    out << "Imported " << report.imported << " of " << report.files << " lesson file(s)";
+    out << " (" << report.duplicates << " duplicate(s), " << report.errors.size() << " error(s))\n";
+}
+
+// --- Catalog Reload ---
+// Each language's catalog is built whole (pack or built-in lessons, replayed
+// imports, instructor overlay, answer keys, search index) and published as a
+// shared_ptr. A rebuild publishes a new catalog rather than changing the one
+// sessions are reading; each session moves to it between commands
+// (refresh_catalog) and keeps its place. The old catalog and everything
+// derived from it are freed with its last reference. On Linux a watcher
+// thread rebuilds when a lesson pack, the overlay or an imported lesson file
+// changes, so content fixes reach running sessions without a restart.
+struct ImportSource {
+    int lang;
+    int level;
+    std::string path;  // absolute
+    bool directory;
+};
+
+std::mutex g_import_sources_mutex;
+std::vector<ImportSource> g_import_sources;
+
+std::shared_ptr<Localization> g_catalogs[kLocaleCount];  // by locale_index; std::atomic_load/atomic_store only
+std::mutex g_catalog_build_mutex;             // one build at a time
+
+std::string absolute_path(const std::string& path) {
+    std::error_code ec;
+    std::filesystem::path p = std::filesystem::absolute(path, ec);
+    std::string normal = (ec ? std::filesystem::path(path) : p).lexically_normal().string();
+    if (normal.size() > 1 && normal.back() == '/') normal.pop_back();
+    return normal;
+}
+
+void retire_catalog(Localization* loc) {
+    forget_catalog(*loc);
+    delete loc;
+}
+
+std::string catalog_pack_path(int lang) {
+    return g_pack_dir + "/lessons_" + locale_code(lang) + ".pack";
+}
+
+// Built-in lessons are read in place; only edited levels are copied
+std::shared_ptr<Localization> build_catalog(int lang, bool use_pack, std::string* error) {
+    const LocaleInfo& info = kLocales[std::max(0, locale_index(lang))];
+    std::unique_ptr<Localization> loc;
+    std::string path = catalog_pack_path(info.id);
+    std::ifstream probe(path);
+    if (use_pack && probe) {
+        loc = open_localization_pack(path, *info.builtin, error);
+        if (!loc) {
+            if (error) *error = path + ": " + *error;
+            return nullptr;
+        }
+    } else {
+        loc = open_builtin_localization(*info.builtin);
+    }
+    std::vector<ImportSource> sources;
+    {
+        std::lock_guard<std::mutex> lock(g_import_sources_mutex);
+        sources = g_import_sources;
+    }
+    for (const ImportSource& source : sources) {
+        if (source.lang != lang || source.level >= level_count(*loc)) continue;
+        Level& level = editable_level(*loc, source.level);
+        std::string ignored;
+        if (source.directory) import_lesson_dir(source.path, level);
+        else import_lesson(source.path, level, &ignored);
+    }
+    apply_instructor_overlay(lang, *loc);
+    compile_answer_keys(*loc);
+    search_index(*loc);
+    return std::shared_ptr<Localization>(loc.release(), retire_catalog);
+}
+
+// Catalog for a language: lessons_<code>.pack if present, else the built-in one.
+// Catalogs are built lazily so only the selected language is loaded; an
+// unknown id gets the first language.
+std::shared_ptr<Localization> current_catalog(int lang) {
+    int i = std::max(0, locale_index(lang));
+    lang = kLocales[i].id;
+    std::shared_ptr<Localization> loc = std::atomic_load(&g_catalogs[i]);
+    if (loc) return loc;
+    std::lock_guard<std::mutex> lock(g_catalog_build_mutex);
+    loc = std::atomic_load(&g_catalogs[i]);
+    if (loc) return loc;
+    std::string error;
+    loc = build_catalog(lang, true, &error);
+    if (!loc) {
+        std::cerr << "Ignoring lesson pack " << error << std::endl;
+        loc = build_catalog(lang, false, &error);
+    }
+    std::atomic_store(&g_catalogs[i], loc);
+    return loc;
+}
+
+Localization* catalog_for(int lang) {
+    return current_catalog(lang).get();
+}
+
+// Rebuilds a language that is in use; a broken pack keeps the current catalog
+bool reload_catalog(int lang, std::string* error) {
+    int i = locale_index(lang);
+    if (i < 0) return true;
+    std::lock_guard<std::mutex> lock(g_catalog_build_mutex);
+    if (!std::atomic_load(&g_catalogs[i])) return true;
+    std::shared_ptr<Localization> fresh = build_catalog(lang, true, error);
+    if (!fresh) return false;
+    std::atomic_store(&g_catalogs[i], fresh);
+    return true;
+}
+
+// Lessons are matched by title (first explanation line) or challenge, so a
+// fix to either still finds its lesson
+bool same_lesson(const LessonView& a, const LessonView& b) {
+    std::string_view title_a = a.explanation.substr(0, a.explanation.find('\n'));
+    std::string_view title_b = b.explanation.substr(0, b.explanation.find('\n'));
+    return title_a == title_b || a.challenge == b.challenge;
+}
+
+// Where a lesson of one catalog is in another: the same index if it still
+// holds that lesson, else wherever the lesson moved within its level, else
+// the nearest index that exists
+int remap_lesson(const Localization& from, const Localization& to, int level, int lesson) {
+    int count = level_lesson_count(to, level);
+    if (count == 0) return 0;
+    if (lesson < 0 || lesson >= level_lesson_count(from, level)) return std::max(0, std::min(lesson, count - 1));
+    LessonView was = lesson_view(from, level, lesson);
+    if (lesson < count && same_lesson(was, lesson_view(to, level, lesson))) return lesson;
+    for (int i = 0; i < count; ++i) {
+        if (same_lesson(was, lesson_view(to, level, i))) return i;
+    }
+    return std::min(lesson, count - 1);
+}
+
+// Between commands: moves a session to the newest catalog of its language,
+// keeping its place. True if the catalog changed.
+bool refresh_catalog(std::shared_ptr<Localization>& catalog, Progress& progress) {
+    std::shared_ptr<Localization> fresh = current_catalog(progress.lang);
+    if (fresh == catalog) return false;
+    if (catalog) {
+        if (progress.level >= level_count(*fresh)) {
+            progress.level = std::max(0, level_count(*fresh) - 1);
+            progress.lesson = 0;
+        } else {
+            progress.bookmark = remap_lesson(*catalog, *fresh, progress.level, progress.bookmark);
+            progress.lesson = remap_lesson(*catalog, *fresh, progress.level, progress.lesson);
+        }
+    }
+    catalog = std::move(fresh);
+    return true;
+}
+
+#if defined(__linux__)
+class CatalogWatcher {
+public:
+    CatalogWatcher() {}
+    CatalogWatcher(const CatalogWatcher&) = delete;
+    CatalogWatcher& operator=(const CatalogWatcher&) = delete;
+    ~CatalogWatcher() { stop(); }
+
+    bool start() {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) return false;
+        if (pipe(wake_pipe_) != 0) {
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        pack_dir_ = absolute_path(g_pack_dir);
+        watch(pack_dir_);
+        {
+            std::lock_guard<std::mutex> lock(g_import_sources_mutex);
+            for (const ImportSource& source : g_import_sources) watch_source(source);
+        }
+        thread_ = std::thread(&CatalogWatcher::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        char c = 0;
+        ssize_t ignored = ::write(wake_pipe_[1], &c, 1);
+        (void)ignored;
+        thread_.join();
+        ::close(wake_pipe_[0]);
+        ::close(wake_pipe_[1]);
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    // Also watch where an imported file or directory tree lives
+    void watch_source(const ImportSource& source) {
+        if (fd_ < 0) return;
+        if (!source.directory) {
+            watch(std::filesystem::path(source.path).parent_path().string());
+            return;
+        }
+        watch(source.path);
+        std::error_code ec;
+        for (std::filesystem::recursive_directory_iterator it(source.path, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->is_directory(ec)) watch(it->path().string());
+        }
+    }
+
+private:
+    static const uint32_t kMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_MODIFY;
+    // Quiet time after the last change before rebuilding, so a burst of
+    // writes (an editor saving, a directory being copied) is one rebuild
+    static const int kSettleMs = 200;
+
+    void watch(const std::string& dir) {
+        std::string path = absolute_path(dir);
+        int wd = inotify_add_watch(fd_, path.c_str(), kMask);
+        if (wd < 0) return;
+        std::lock_guard<std::mutex> lock(dirs_mutex_);
+        dirs_[wd] = path;
+    }
+
+    // Languages (bit locale_index) whose catalog a change to dir/name affects
+    unsigned languages_touched(const std::string& dir, const std::string& name, uint32_t mask) {
+        if (dir == pack_dir_) {
+            if (name == "lessons.overlay") return (1u << kLocaleCount) - 1;
+            if (mask & IN_MODIFY) return 0;  // packs are read once complete
+            for (size_t i = 0; i < kLocaleCount; ++i) {
+                if (name == std::string("lessons_") + kLocales[i].code + ".pack") return 1u << i;
+            }
+        }
+        if (mask & IN_MODIFY) return 0;
+        std::string path = dir + "/" + name;
+        unsigned langs = 0;
+        std::lock_guard<std::mutex> lock(g_import_sources_mutex);
+        for (const ImportSource& source : g_import_sources) {
+            bool inside = source.directory ? path.compare(0, source.path.size() + 1, source.path + "/") == 0 : path == source.path;
+            if (inside) langs |= 1u << std::max(0, locale_index(source.lang));
+        }
+        return langs;
+    }
+
+    void run() {
+        alignas(inotify_event) char buf[4096];
+        unsigned pending = 0;
+        for (;;) {
+            struct pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+            int ready = poll(fds, 2, pending ? kSettleMs : -1);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready < 0 || (fds[1].revents & POLLIN)) return;
+            if (ready == 0) {
+                for (size_t i = 0; i < kLocaleCount; ++i) {
+                    std::string error;
+                    if ((pending & (1u << i)) && !reload_catalog(kLocales[i].id, &error)) {
+                        std::cerr << "Keeping the current lessons: " << error << std::endl;
+                    }
+                }
+                pending = 0;
+                continue;
+            }
+            ssize_t n = ::read(fd_, buf, sizeof(buf));
+            for (ssize_t pos = 0; n > 0 && pos < n;) {
+                const inotify_event* ev = reinterpret_cast<const inotify_event*>(buf + pos);
+                pos += sizeof(inotify_event) + ev->len;
+                if (ev->len == 0) continue;
+                std::string dir;
+                {
+                    std::lock_guard<std::mutex> lock(dirs_mutex_);
+                    auto it = dirs_.find(ev->wd);
+                    if (it == dirs_.end()) continue;
+                    dir = it->second;
+                }
+                std::string name(ev->name);
+                unsigned langs = languages_touched(dir, name, ev->mask);
+                // New subdirectories of an imported tree are watched too
+                if ((ev->mask & IN_CREATE) && (ev->mask & IN_ISDIR) && langs) watch(dir + "/" + name);
+                pending |= langs;
+            }
+        }
+    }
+
+    int fd_ = -1;
+    int wake_pipe_[2] = {-1, -1};
+    std::string pack_dir_;
+    std::mutex dirs_mutex_;
+    std::map<int, std::string> dirs_;  // watch descriptor -> directory
+    std::thread thread_;
+};
+
+CatalogWatcher g_catalog_watcher;
+#endif
+
+// Remembers an import so rebuilt catalogs include it, then rebuilds.
+// Importing the same file again takes its current content.
+void add_import_source(int lang, int level, const std::string& path, bool directory) {
+    ImportSource source{lang, level, absolute_path(path), directory};
+    bool known = false;
+    {
+        std::lock_guard<std::mutex> lock(g_import_sources_mutex);
+        for (const ImportSource& s : g_import_sources) {
+            known = known || (s.lang == lang && s.level == level && s.path == source.path);
+        }
+        if (!known) g_import_sources.push_back(source);
+    }
+#if defined(__linux__)
+    if (!known) g_catalog_watcher.watch_source(source);
+#endif
+    std::string error;
+    if (!reload_catalog(lang, &error)) std::cerr << "Keeping the current lessons: " << error << std::endl;
+}
+
+// --- Analytics ---
+// ./learn --analyze reads every learner's event log (see Event Log) on a pool
+// of threads and prints, per lesson: attempts and pass rate over challenge
+// and quiz answers, time-to-answer percentiles, skips, solution reveals and
+// hints, how many learners reached the lesson and how many stopped there
+// (their last event). Each thread aggregates its share of the logs into its
+// own columns; the columns are merged once at the end.
+class EventAnalysis {
+public:
+    static uint64_t row_key(int lang, int level, uint32_t lesson) {
+        return ((uint64_t)lang << 56) | ((uint64_t)level << 40) | lesson;
+    }
+
+    // One learner's log, in append order
+    void add_learner(const EventRecord* records, size_t count) {
+        if (count == 0) return;
+        ++learners_;
+        events_ += count;
+        std::vector<uint32_t> reached;
+        for (size_t i = 0; i < count; ++i) {
+            const EventRecord& r = records[i];
+            uint32_t row = row_for(row_key(r.lang, r.level, r.lesson));
+            reached.push_back(row);
+            switch ((EventKind)r.kind) {
+            case EventKind::ChallengeAnswer:
+            case EventKind::QuizAnswer:
+            case EventKind::Review:
+            case EventKind::CodeRun:
+                ++attempts_[row];
+                passes_[row] += r.passed;
+                answer_ms_[row].push_back(r.answer_ms);
+                break;
+            case EventKind::Skip: ++skips_[row]; break;
+            case EventKind::Solution: ++reveals_[row]; break;
+            case EventKind::Hint: ++hints_[row]; break;
+            }
+        }
+        std::sort(reached.begin(), reached.end());
+        reached.erase(std::unique(reached.begin(), reached.end()), reached.end());
+        for (uint32_t row : reached) ++learners_at_[row];
+        const EventRecord& last = records[count - 1];
+        ++stopped_[row_for(row_key(last.lang, last.level, last.lesson))];
+    }
+
+    void merge(EventAnalysis& other) {
+        learners_ += other.learners_;
+        events_ += other.events_;
+        for (size_t i = 0; i < other.key_.size(); ++i) {
+            uint32_t row = row_for(other.key_[i]);
+            attempts_[row] += other.attempts_[i];
+            passes_[row] += other.passes_[i];
+            skips_[row] += other.skips_[i];
+            reveals_[row] += other.reveals_[i];
+            hints_[row] += other.hints_[i];
+            learners_at_[row] += other.learners_at_[i];
+            stopped_[row] += other.stopped_[i];
+            std::vector<uint32_t>& ms = answer_ms_[row];
+            ms.insert(ms.end(), other.answer_ms_[i].begin(), other.answer_ms_[i].end());
+        }
+    }
+
+    void print(std::ostream& out, size_t files) {
+        out << "Analyzed " << events_ << " event(s) from " << learners_ << " learner(s) in " << files << " log(s)\n";
+        std::vector<uint32_t> order(key_.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return key_[a] < key_[b]; });
+        uint64_t current_level = ~0ull;
+        std::vector<uint32_t> level_rows;
+        auto finish_level = [&] {
+            // Hardest: lowest pass rate among lessons answered often enough to tell
+            std::vector<uint32_t> rated;
+            for (uint32_t row : level_rows) if (attempts_[row] >= 5) rated.push_back(row);
+            std::sort(rated.begin(), rated.end(), [this](uint32_t a, uint32_t b) {
+                return (uint64_t)passes_[a] * attempts_[b] < (uint64_t)passes_[b] * attempts_[a];
+            });
+            if (rated.size() > 3) rated.resize(3);
+            if (!rated.empty()) {
+                out << "  Hardest:";
+                for (uint32_t row : rated) out << " #" << ((key_[row] & 0xFFFFFFFFu) + 1) << " (" << pass_rate(row) << "%)";
+                out << '\n';
+            }
+            level_rows.clear();
+        };
+        for (uint32_t row : order) {
+            uint64_t key = key_[row];
+            int lang = (int)(key >> 56), level = (int)((key >> 40) & 0xFFFF);
+            uint32_t lesson = (uint32_t)(key & 0xFFFFFFFFu);
+            if ((key >> 40) != current_level) {
+                if (current_level != ~0ull) finish_level();
+                current_level = key >> 40;
+                out << '\n' << locale_code(lang) << " level " << (level + 1) << '\n'
+                    << "  lesson  answers  pass%   p50 s   p90 s  skips  reveals  hints  reached  stopped  title\n";
+            }
+            level_rows.push_back(row);
+            std::vector<uint32_t>& ms = answer_ms_[row];
+            out << "  " << std::setw(6) << (lesson + 1) << std::setw(9) << attempts_[row] << std::setw(7);
+            if (attempts_[row]) out << pass_rate(row); else out << '-';
+            out << std::fixed << std::setprecision(1);
+            if (ms.empty()) out << std::setw(8) << '-' << std::setw(8) << '-';
+            else out << std::setw(8) << percentile(ms, 50) / 1000.0 << std::setw(8) << percentile(ms, 90) / 1000.0;
+            out << std::setw(7) << skips_[row] << std::setw(9) << reveals_[row] << std::setw(7) << hints_[row]
+                << std::setw(9) << learners_at_[row] << std::setw(9) << stopped_[row] << "  " << lesson_title(lang, level, lesson) << '\n';
+        }
+        if (current_level != ~0ull) finish_level();
+    }
+
+private:
+    uint32_t row_for(uint64_t key) {
+        auto it = row_of_.find(key);
+        if (it != row_of_.end()) return it->second;
+        uint32_t row = (uint32_t)key_.size();
+        row_of_.emplace(key, row);
+        key_.push_back(key);
+        attempts_.push_back(0);
+        passes_.push_back(0);
+        skips_.push_back(0);
+        reveals_.push_back(0);
+        hints_.push_back(0);
+        learners_at_.push_back(0);
+        stopped_.push_back(0);
+        answer_ms_.emplace_back();
+        return row;
+    }
+
+    int pass_rate(uint32_t row) const {
+        return attempts_[row] ? (int)(100.0 * passes_[row] / attempts_[row] + 0.5) : 0;
+    }
+
+    static uint32_t percentile(std::vector<uint32_t>& values, int p) {
+        size_t k = (values.size() - 1) * p / 100;
+        std::nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    }
+
+    // First line of the lesson's explanation, if the catalog still has it
+    static std::string lesson_title(int lang, int level, uint32_t lesson) {
+        if (!find_locale(lang)) return std::string();
+        const Localization& loc = *catalog_for(lang);
+        if (level >= level_count(loc) || (int)lesson >= level_lesson_count(loc, level)) return "(not in catalog)";
+        std::string_view text = lesson_view(loc, level, (int)lesson).explanation;
+        return std::string(text.substr(0, text.find('\n')));
+    }
+
+    uint64_t learners_ = 0;
+    uint64_t events_ = 0;
+    std::unordered_map<uint64_t, uint32_t> row_of_;
+    // One entry per (language, level, lesson) row
+    std::vector<uint64_t> key_;
+    std::vector<uint32_t> attempts_, passes_, skips_, reveals_, hints_, learners_at_, stopped_;
+    std::vector<std::vector<uint32_t>> answer_ms_;
+};
+
+int analyze_events(const std::string& dir) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".log") files.push_back(it->path().string());
+    }
+    if (ec) {
+        std::cerr << "Cannot read " << dir << ": " << ec.message() << std::endl;
+        return 1;
+    }
+    size_t thread_count = std::max<size_t>(1, std::min<size_t>(files.size(), std::max(1u, std::thread::hardware_concurrency())));
+    std::vector<EventAnalysis> partial(thread_count);
+    std::atomic<size_t> next{0};
+    auto work = [&](EventAnalysis& into) {
+        std::vector<EventRecord> records;
+        for (size_t i = next++; i < files.size(); i = next++) {
+            int fd = ::open(files[i].c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0) continue;
+            // A torn last record is left out
+            size_t count = fstat(fd, &st) == 0 ? (size_t)st.st_size / sizeof(EventRecord) : 0;
+            records.resize(count);
+            if (count > 0 && read_full(fd, records.data(), count * sizeof(EventRecord), 0)) into.add_learner(records.data(), count);
+            ::close(fd);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < thread_count; ++t) pool.emplace_back(work, std::ref(partial[t]));
+    work(partial[0]);
+    for (std::thread& t : pool) t.join();
+    for (size_t t = 1; t < thread_count; ++t) partial[0].merge(partial[t]);
+    partial[0].print(std::cout, files.size());
+    return 0;
+}
+
+// --- Catalog Verification ---
+// ./learn --verify-catalog compiles and runs the sample code of every lesson
+// in every level of both catalogs, including packs, imports and instructor
+// edits. It checks what each sample prints against the lesson's expected
+// output. A fragment is tried first as statements inside main(), then as
+// declarations followed by an empty main(). Samples that are only comments
+// are skipped. All builds share a precompiled header of the usual includes.
+// They go through the compile cache with one worker per core, and the runs
+// are sandboxed as in "run".
+enum class VerifyResult { Pass, Silent, Mismatch, CompileError, RunError, Skipped };
+const char* const kVerifyResultNames[] = {"pass", "no output", "mismatch", "compile error", "run error", "skipped"};
+
+struct LessonCheck {
+    int lang = 0;
+    int level = 0;
+    int lesson = 0;
+    VerifyResult result = VerifyResult::Skipped;
+    bool cached = false;
+    double compile_ms = 0;
+    double run_ms = 0;
+    std::string detail;
+};
+
+bool is_comment_only(std::string_view code) {
+    size_t start = 0;
+    while (start < code.size()) {
+        size_t end = code.find('\n', start);
+        if (end == std::string_view::npos) end = code.size();
+        std::string_view line = code.substr(start, end - start);
+        size_t text = line.find_first_not_of(" \t\r");
+        if (text != std::string_view::npos && line.compare(text, 2, "//") != 0) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+std::string first_line(std::string_view text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return "";
+    return std::string(text.substr(start, text.find('\n', start) - start));
+}
+
+// The prelude as a header, precompiled next to itself on first use. A
+// failed precompile only makes the builds slower.
+std::string prelude_header() {
+    std::string cxx = compiler_command();
+    uint64_t key = fnv1a(kProgramPrelude, sizeof(kProgramPrelude) - 1, fnv1a(cxx.data(), cxx.size()));
+    char name[40];
+    snprintf(name, sizeof(name), "/prelude-%016llx.h", (unsigned long long)key);
+    std::string header = g_compiler.dir() + name;
+    if (access((header + ".gch").c_str(), R_OK) == 0) return header;
+    std::error_code ec;
+    std::filesystem::create_directories(g_compiler.dir(), ec);
+    std::string tmp = "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(header + tmp, std::ios::binary | std::ios::trunc);
+        out << kProgramPrelude;
+    }
+    std::rename((header + tmp).c_str(), header.c_str());
+    std::vector<std::string> args{cxx};
+    args.insert(args.end(), std::begin(kCompileFlags), std::end(kCompileFlags));
+    args.insert(args.end(), {"-x", "c++-header", header, "-o", header + ".gch" + tmp});
+    SandboxLimits limits{60, (rlim_t)2 << 30, (rlim_t)256 << 20, false};
+    ProcessResult built = run_process(args, g_compiler.dir(), limits, true, kCompileTimeoutMs);
+    bool ok = built.started && !built.timed_out && WIFEXITED(built.status) && WEXITSTATUS(built.status) == 0;
+    if (!(ok && std::rename((header + ".gch" + tmp).c_str(), (header + ".gch").c_str()) == 0)) unlink((header + ".gch" + tmp).c_str());
+    return header;
+}
+
+LessonCheck check_lesson(const Localization& loc, int level, int lesson, const std::string& prelude) {
+    LessonCheck check;
+    check.level = level;
+    check.lesson = lesson;
+    LessonView view = lesson_view(loc, level, lesson);
+    std::string code(view.code);
+    if (is_comment_only(code)) return check;
+    std::vector<std::string> sources;
+    if (has_main(code)) sources.push_back(code);
+    else sources = {main_wrapped(code), "#line 1 \"program.cpp\"\n" + code + "\nint main() {}\n"};
+    auto started = std::chrono::steady_clock::now();
+    CompileResult build;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        CompileResult attempt = g_compiler.submit(sources[i], {"-include", prelude}).get();
+        // If nothing compiles, the statement form's errors are the ones to show
+        if (attempt.ok || i == 0) build = attempt;
+        if (attempt.ok) break;
+    }
+    check.cached = build.cached;
+    check.compile_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    if (!build.ok) {
+        check.result = VerifyResult::CompileError;
+        // The first error with its position
+        size_t error = build.diagnostics.find("error:");
+        size_t line = error == std::string::npos ? 0 : build.diagnostics.rfind('\n', error) + 1;
+        check.detail = first_line(std::string_view(build.diagnostics).substr(line == std::string::npos ? 0 : line));
+        return check;
+    }
+    RunReport report;
+    started = std::chrono::steady_clock::now();
+    run_program(build.binary, view.expected_output, report);
+    check.run_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    if (!report.finished) {
+        check.result = VerifyResult::RunError;
+        check.detail = "the program " + report.diagnostics;
+    } else if (report.passed) {
+        check.result = VerifyResult::Pass;
+    } else if (report.output.find_first_not_of(" \t\r\n") == std::string::npos) {
+        check.result = VerifyResult::Silent;
+    } else {
+        check.result = VerifyResult::Mismatch;
+        check.detail = "printed \"" + first_line(report.output) + "\", expected \"" + first_line(view.expected_output) + "\"";
+    }
+    return check;
+}
+
+int verify_catalog() {
+    auto started = std::chrono::steady_clock::now();
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    g_compiler.set_workers((int)cores);
+    std::string prelude = prelude_header();
+    double prelude_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::vector<LessonCheck> checks;
+    const Localization* catalogs[kLocaleCount];
+    for (size_t i = 0; i < kLocaleCount; ++i) {
+        catalogs[i] = catalog_for(kLocales[i].id);
+        for (int level = 0; level < level_count(*catalogs[i]); ++level) {
+            for (int lesson = 0; lesson < level_lesson_count(*catalogs[i], level); ++lesson) {
+                LessonCheck check;
+                check.lang = kLocales[i].id;
+                check.level = level;
+                check.lesson = lesson;
+                checks.push_back(check);
+            }
+        }
+    }
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i = next++; i < checks.size(); i = next++) {
+            int lang = checks[i].lang;
+            checks[i] = check_lesson(*catalogs[locale_index(lang)], checks[i].level, checks[i].lesson, prelude);
+            checks[i].lang = lang;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min<size_t>(cores, checks.size()); ++t) pool.emplace_back(work);
+    work();
+    for (std::thread& t : pool) t.join();
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    size_t counts[6] = {};
+    size_t built = 0, cached = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < checks.size(); ++i) {
+        const LessonCheck& c = checks[i];
+        const Localization& loc = *catalogs[locale_index(c.lang)];
+        if (i == 0 || c.lang != checks[i - 1].lang || c.level != checks[i - 1].level) {
+            std::cout << (i ? "\n" : "") << locale_code(c.lang) << " level " << c.level + 1 << " (" << loc.levels[c.level].name << ")\n"
+                      << "  lesson  result         compile ms   run ms  title\n";
+        }
+        ++counts[(size_t)c.result];
+        if (c.result != VerifyResult::Skipped) ++(c.cached ? cached : built);
+        std::cout << std::setw(8) << c.lesson + 1 << "  " << std::left << std::setw(13) << kVerifyResultNames[(size_t)c.result] << std::right;
+        if (c.result == VerifyResult::Skipped) std::cout << std::setw(12) << "-" << std::setw(9) << "-";
+        else std::cout << std::setw(12) << c.compile_ms << std::setw(9) << c.run_ms;
+        std::cout << "  " << first_line(lesson_view(loc, c.level, c.lesson).explanation) << '\n';
+        if (!c.detail.empty()) std::cout << "          " << c.detail << '\n';
+    }
+    size_t failed = counts[(size_t)VerifyResult::Mismatch] + counts[(size_t)VerifyResult::CompileError] + counts[(size_t)VerifyResult::RunError];
+    std::cout << "\nChecked " << checks.size() << " lesson(s) on " << cores << " core(s) in " << elapsed_s << " s"
+              << " (precompiled header " << prelude_s << " s; " << built << " built, " << cached << " cached)\n"
+              << counts[(size_t)VerifyResult::Pass] << " pass, " << counts[(size_t)VerifyResult::Silent] << " without output, "
+              << counts[(size_t)VerifyResult::Mismatch] << " mismatch(es), " << counts[(size_t)VerifyResult::CompileError] << " compile error(s), "
+              << counts[(size_t)VerifyResult::RunError] << " run error(s), " << counts[(size_t)VerifyResult::Skipped] << " skipped\n";
+    return failed ? 2 : 0;
+}
+
+// --- Lesson Commands ---
+// Every spelling of every lesson-loop command, in every language, is a row
+// in kCommandAliases. A collision-free hash over the aliases is searched for
+// at compile time, so parsing a command is one hash and one compare. Each
+// command has one handler shared by all languages; adding a language means
+// adding rows here and its UI strings, not another if/else chain.
+enum class Command : uint8_t {
+    Unknown, Next, Back, Repeat, Code, Solution, Note, Notes, NotesHere,
+    Bookmark, Goto, Mode, Exit, Review, Import, ImportDir, Search, Due, Run
+};
+
+struct CommandAlias {
+    std::string_view text;
+    Command id;
+};
+
+constexpr CommandAlias kCommandAliases[] = {
+    {"next", Command::Next},             {"التالي", Command::Next},
+    {"back", Command::Back},             {"السابق", Command::Back},
+    {"repeat", Command::Repeat},         {"إعادة", Command::Repeat},
+    {"code", Command::Code},             {"الكود", Command::Code},
+    {"solution", Command::Solution},     {"الحل", Command::Solution},
+    {"note", Command::Note},             {"ملاحظة", Command::Note},
+    {"notes", Command::Notes},           {"ملاحظات", Command::Notes},
+    {"notes here", Command::NotesHere},  {"ملاحظات الدرس", Command::NotesHere},
+    {"bookmark", Command::Bookmark},     {"علامة", Command::Bookmark},
+    {"goto", Command::Goto},             {"اذهب", Command::Goto},
+    {"mode", Command::Mode},             {"وضع", Command::Mode},
+    {"exit", Command::Exit},             {"خروج", Command::Exit},
+    {"review", Command::Review},         {"مراجعة", Command::Review},
+    {"import", Command::Import},         {"استيراد", Command::Import},
+    {"import-dir", Command::ImportDir},  {"استيراد مجلد", Command::ImportDir},
+    {"search", Command::Search},         {"بحث", Command::Search},
+    {"due", Command::Due},               {"المستحق", Command::Due},
+    {"run", Command::Run},               {"تشغيل", Command::Run},
+};
+
+constexpr size_t kCommandAliasCount = sizeof(kCommandAliases) / sizeof(kCommandAliases[0]);
+constexpr size_t kCommandSlots = 128;
+
+constexpr uint32_t command_hash(std::string_view text, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : text) {
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+    // FNV's low bits barely depend on the seed; mix the high bits down
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// First seed that puts every alias in its own slot
+constexpr uint32_t find_command_seed() {
+    for (uint32_t seed = 0; seed < 4096; ++seed) {
+        bool used[kCommandSlots] = {};
+        bool distinct = true;
+        for (size_t i = 0; i < kCommandAliasCount && distinct; ++i) {
+            size_t slot = command_hash(kCommandAliases[i].text, seed) % kCommandSlots;
+            distinct = !used[slot];
+            used[slot] = true;
+        }
+        if (distinct) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t kCommandSeed = find_command_seed();
+static_assert(kCommandSeed != UINT32_MAX, "no collision-free seed for kCommandAliases; grow kCommandSlots");
+
+struct CommandSlotTable {
+    uint8_t alias[kCommandSlots];  // index into kCommandAliases + 1; 0 = empty
+};
+
+constexpr CommandSlotTable build_command_slots() {
+    CommandSlotTable table = {};
+    for (size_t i = 0; i < kCommandAliasCount; ++i) {
+        table.alias[command_hash(kCommandAliases[i].text, kCommandSeed) % kCommandSlots] = (uint8_t)(i + 1);
+    }
+    return table;
+}
+
+constexpr CommandSlotTable kCommandSlotTable = build_command_slots();
+
+Command lookup_command(std::string_view text) {
+    uint8_t alias = kCommandSlotTable.alias[command_hash(text, kCommandSeed) % kCommandSlots];
+    if (alias == 0 || kCommandAliases[alias - 1].text != text) return Command::Unknown;
+    return kCommandAliases[alias - 1].id;
+}
+
+// A whole-line alias wins ("notes here"); otherwise commands that take
+// arguments match on their first word ("search vector push")
+Command parse_command(std::string_view input, std::string_view* args) {
+    *args = std::string_view();
+    Command id = lookup_command(input);
+    size_t space = input.find(' ');
+    if (id != Command::Unknown || space == std::string_view::npos) return id;
+    id = lookup_command(input.substr(0, space));
+    if (id != Command::Search) return Command::Unknown;
+    *args = input.substr(space + 1);
+    return id;
+}
+
+// What the lesson loop does after a command
+enum class CommandResult {
+    Done,    // go on to the end-of-level check
+    Redraw,  // show the lesson again right away
+    Quit     // leave the lesson loop
+};
+
+struct CommandContext {
+    Progress& progress;
+    Localization* loc;
+    const LessonView& current;
+    int lesson_count;
+    bool& in_review_mode;
+    bool& instructor_mode_active;
+    ReviewSchedule& reviews;
+    std::string_view args;  // text after the command word, if it takes any
+};
+
+std::string fill_placeholder(std::string text, const char* key, int value) {
+    size_t pos = text.find(key);
+    if (pos != std::string::npos) text.replace(pos, std::strlen(key), std::to_string(value));
+    return text;
+}
+
+CommandResult command_next(CommandContext& c) {
+    Progress& p = c.progress;
+    if (p.lesson >= c.lesson_count - 1) {
+        std::cout << c.loc->next_last << '\n';
+        wait_for_enter();
+        return CommandResult::Done;
+    }
+    p.lesson++;
+    p.xp += 10;
+    p.daily_progress++;
+    p.total_xp += 10;
+    p.total_lessons_completed++;
+    p.weekly_xp += 10;
+    p.weekly_lessons++;
+    std::cout << "\033[32m" << c.loc->xp_earned << p.xp << "\033[0m\n";
+    std::string goal = fill_placeholder(fill_placeholder(c.loc->daily_goal_progress, "{done}", p.daily_progress), "{goal}", p.daily_goal);
+    std::cout << "\033[33m" << goal << "\033[0m\n";
+    if (p.daily_progress >= p.daily_goal) std::cout << "\033[32m" << c.loc->daily_goal_reached << "\033[0m\n";
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_back(CommandContext& c) {
+    if (c.progress.lesson > 0) {
+        c.progress.lesson--;
+    } else {
+        std::cout << c.loc->back_first << '\n';
+        wait_for_enter();
+    }
+    return CommandResult::Done;
+}
+
+CommandResult command_repeat(CommandContext&) {
+    return CommandResult::Redraw;
+}
+
+CommandResult command_code(CommandContext& c) {
+    clear_screen();
+    type_text(c.loc->code_header, 15);
+    std::cout << c.current.code << '\n';
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_solution(CommandContext& c) {
+    record_event(EventKind::Solution, c.progress.lang, c.progress.level, c.progress.lesson);
+    clear_screen();
+    type_text(c.loc->solution_header, 15);
+    std::cout << c.current.solution << '\n';
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_note(CommandContext& c) {
+    std::cout << c.loc->note_prompt;
+    std::string note;
+    read_line(note, "note");
+    save_note(c.progress.lang, c.progress.level, c.progress.lesson, note);
+    std::cout << "\033[32m" << c.loc->note_saved << "\033[0m\n";
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_notes(CommandContext& c) {
+    display_notes(c.loc, c.progress.lang, c.progress.level, c.progress.lesson, false);
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_notes_here(CommandContext& c) {
+    display_notes(c.loc, c.progress.lang, c.progress.level, c.progress.lesson, true);
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_bookmark(CommandContext& c) {
+    c.progress.bookmark = c.progress.lesson;
+    std::cout << "\033[32m" << c.loc->bookmark_saved << (c.progress.lesson + 1) << "\033[0m\n";
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_goto(CommandContext& c) {
+    if (c.progress.bookmark >= 0 && c.progress.bookmark < c.lesson_count) {
+        c.progress.lesson = c.progress.bookmark;
+        std::cout << "\033[32m" << c.loc->bookmark_loaded << (c.progress.lesson + 1) << "\033[0m\n";
+    } else {
+        std::cout << "\033[31m" << c.loc->no_bookmark << "\033[0m\n";
+    }
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+CommandResult command_mode(CommandContext& c) {
+    if (instructor_mode_edit(c.loc, c.progress.lang, c.progress.level, c.progress.lesson)) c.instructor_mode_active = true;
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+// In review mode, exit only leaves review mode
+CommandResult command_exit(CommandContext& c) {
+    if (c.in_review_mode) {
+        c.in_review_mode = false;
+        return CommandResult::Redraw;
+    }
+    std::cout << c.loc->goodbye << '\n';
+    return CommandResult::Quit;
+}
+
+CommandResult command_review(CommandContext& c) {
+    c.in_review_mode = true;
+    return CommandResult::Redraw;
+}
+
+CommandResult command_due(CommandContext& c) {
+    run_daily_review(*c.loc, c.progress.lang, c.reviews, c.progress.xp, c.progress.total_xp);
+    return CommandResult::Redraw;
+}
+
+// Compile and run the learner's own program against the lesson's expected output
+CommandResult command_run(CommandContext& c) {
+    if (t_session) {
+        // The program would run as the server, next to every learner's data
+        std::cout << "\033[31mRunning programs is not available in a shared session.\033[0m\n";
+        wait_for_enter();
+        return CommandResult::Redraw;
+    }
+    if (c.current.expected_output.empty()) {
+        std::cout << "This lesson has no expected output to check a program against.\n";
+        wait_for_enter();
+        return CommandResult::Redraw;
+    }
+    std::cout << "Type your program (a main() is added if it has none), then a line with just end:\n";
+    auto asked = std::chrono::steady_clock::now();
+    std::string source, line;
+    while (read_line(line, "code") && line != "end") {
+        source += line;
+        source += '\n';
+        if (source.size() > kRunSourceMax) {
+            std::cout << "\033[31mPrograms are limited to " << kRunSourceMax / 1024 << " KiB.\033[0m\n";
+            wait_for_enter();
+            return CommandResult::Redraw;
+        }
+    }
+    if (source.empty()) return CommandResult::Redraw;
+    uint32_t answer_ms = elapsed_ms(asked);
+    std::cout << "Compiling and running..." << std::endl;
+    RunReport report = run_learner_code(source, c.current.expected_output);
+    record_event(EventKind::CodeRun, c.progress.lang, c.progress.level, c.progress.lesson, report.passed, answer_ms);
+    c.reviews.grade(c.progress.lang, c.progress.level, c.progress.lesson, review_quality(report.passed, 0, answer_ms), local_day(clock_now()));
+    if (!report.compiled) {
+        std::cout << "\033[31mYour program did not compile:\033[0m\n" << report.diagnostics << '\n';
+    } else {
+        // Enough of the output to compare by eye; the check used all of it
+        const size_t kShownOutput = 2048;
+        std::cout << "Output:\n" << report.output.substr(0, kShownOutput);
+        if (report.output.size() > kShownOutput) std::cout << "\n[... " << report.output.size() - kShownOutput << " more bytes]";
+        if (!report.output.empty() && report.output.back() != '\n') std::cout << '\n';
+        if (!report.diagnostics.empty()) std::cout << "\033[31mThe program " << report.diagnostics << ".\033[0m\n";
+        if (report.passed) {
+            c.progress.xp += 10;
+            c.progress.total_xp += 10;
+            c.progress.weekly_xp += 10;
+            std::cout << "\033[32m✅ Output matches! You earned 10 XP! Total: " << c.progress.xp << "\033[0m\n";
+        } else if (report.finished) {
+            std::cout << "\033[31m❌ Expected:\033[0m\n" << c.current.expected_output << '\n';
+        }
+    }
+    wait_for_enter();
+    return CommandResult::Redraw;
+}
+
+CommandResult command_import(CommandContext& c) {
+    if (t_session) {
+        std::cout << "\033[31mImporting lessons is not available in a shared session.\033[0m\n";
+        wait_for_enter();
+        return CommandResult::Redraw;
+    }
+    std::cout << "Enter filename to import: ";
+    std::string fname;
+    read_line(fname, "import");
+    std::string error;
+    if (import_lesson(fname, editable_level(*c.loc, c.progress.level), &error)) {
+        catalog_level_changed(*c.loc, c.progress.level);
+        add_import_source(c.progress.lang, c.progress.level, fname, false);
+        std::cout << "\033[32mLesson imported successfully!\033[0m\n";
+    } else {
+        std::cout << "\033[31mFailed to import lesson: " << error << "\033[0m\n";
+    }
+    wait_for_enter();
+    return CommandResult::Redraw;
+}
+
+CommandResult command_import_dir(CommandContext& c) {
+    if (t_session) {
+        std::cout << "\033[31mImporting lessons is not available in a shared session.\033[0m\n";
+        wait_for_enter();
+        return CommandResult::Redraw;
+    }
+    std::cout << "Enter directory to import: ";
+    std::string dir;
+    read_line(dir, "import");
+    ImportReport report = import_lesson_dir(dir, editable_level(*c.loc, c.progress.level));
+    if (report.imported > 0) catalog_level_changed(*c.loc, c.progress.level);
+    if (report.files > 0) add_import_source(c.progress.lang, c.progress.level, dir, true);
+    print_import_report(report, std::cout);
+    wait_for_enter();
+    return CommandResult::Redraw;
+}
+
+CommandResult command_search(CommandContext& c) {
+    std::string query(c.args);
+    if (query.empty()) {
+        std::cout << c.loc->search_prompt;
+        read_line(query, "search");
+    }
+    std::vector<SearchIndex::Hit> hits = search_index(*c.loc).search(query, 10);
+    if (hits.empty()) {
+        std::cout << c.loc->search_none << '\n';
+        wait_for_enter();
+        return CommandResult::Redraw;
+    }
+    for (size_t i = 0; i < hits.size(); ++i) {
+        std::string_view explanation = lesson_view(*c.loc, hits[i].level, hits[i].lesson).explanation;
+        std::cout << (i + 1) << ") " << c.loc->levels[hits[i].level].name << " · " << (hits[i].lesson + 1) << ": "
+                  << explanation.substr(0, explanation.find('\n')) << '\n';
+    }
+    std::cout << c.loc->search_open;
+    std::string choice;
+    read_line(choice, "select");
+    int picked = atoi(choice.c_str());
+    if (picked >= 1 && picked <= (int)hits.size()) {
+        c.progress.level = hits[picked - 1].level;
+        c.progress.lesson = hits[picked - 1].lesson;
+    }
+    return CommandResult::Redraw;
+}
+
+CommandResult command_unknown(CommandContext& c) {
+    std::cout << c.loc->invalid_command << '\n';
+    wait_for_enter();
+    return CommandResult::Done;
+}
+
+using CommandHandler = CommandResult (*)(CommandContext&);
+
+// Indexed by Command
+const CommandHandler kCommandHandlers[] = {
+    command_unknown, command_next, command_back, command_repeat, command_code, command_solution,
+    command_note, command_notes, command_notes_here, command_bookmark, command_goto, command_mode,
+    command_exit, command_review, command_import, command_import_dir, command_search, command_due,
+    command_run
+};
+static_assert(sizeof(kCommandHandlers) / sizeof(kCommandHandlers[0]) == (size_t)Command::Run + 1,
+              "kCommandHandlers must have one entry per Command");
+
+// --- Metrics Export ---
+// Metrics are written to a file (metrics.prom next to the progress store,
+// or --metrics <file>) when the process exits and whenever it receives
+// SIGUSR1. The signal handler only writes a byte to a pipe; a small thread
+// does the formatting and replaces the file with a rename, so readers never
+// see half a dump. Buckets are exported at each power of two from 1 us to
+// about a minute, which match internal bucket edges exactly.
+static_assert((size_t)Command::Run < kMaxCommandMetrics, "grow kMaxCommandMetrics");
+
+const int kExportFirstPower = 10;  // 2^10 ns, about 1 us
+const int kExportLastPower = 36;   // about 69 s
+
+// The English spelling of each command, for labels
+std::string_view command_label(size_t id) {
+    if (id == (size_t)Command::Unknown) return "unknown";
+    for (const CommandAlias& alias : kCommandAliases) {
+        if ((size_t)alias.id == id) return alias.text;
+    }
+    return "unknown";
+}
+
+void write_histogram(std::ostream& out, const char* name, const std::string& labels, const LatencyHistogram& h) {
+    uint64_t cumulative = 0;
+    int next_bucket = 0;
+    for (int power = kExportFirstPower; power <= kExportLastPower; ++power) {
+        int end = LatencyHistogram::bucket_for((uint64_t)1 << power);
+        for (; next_bucket < end; ++next_bucket) cumulative += h.bucket(next_bucket);
+        out << name << "_bucket{" << labels << ",le=\"" << std::setprecision(12) << std::defaultfloat
+            << (double)((uint64_t)1 << power) / 1e9 << "\"} " << cumulative << '\n';
+    }
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << h.count() << '\n';
+    out << name << "_sum{" << labels << "} " << std::fixed << std::setprecision(9) << (double)h.sum_ns() / 1e9 << '\n';
+    out << name << "_count{" << labels << "} " << h.count() << '\n';
+}
+
+void write_metrics(std::ostream& out) {
+    out << "# HELP learn_phase_seconds Time spent in each phase of a lesson-loop iteration.\n"
+        << "# TYPE learn_phase_seconds histogram\n";
+    for (size_t p = 0; p < kPhaseCount; ++p) {
+        write_histogram(out, "learn_phase_seconds", std::string("phase=\"") + kPhaseNames[p] + "\"", g_metrics.phases[p]);
+    }
+    out << "# HELP learn_command_seconds Time spent handling each lesson-loop command.\n"
+        << "# TYPE learn_command_seconds histogram\n";
+    for (size_t c = 0; c <= (size_t)Command::Run; ++c) {
+        if (g_metrics.commands[c].count() == 0) continue;
+        write_histogram(out, "learn_command_seconds", "command=\"" + std::string(command_label(c)) + "\"", g_metrics.commands[c]);
+    }
+}
+
+int g_metrics_signal_pipe[2] = {-1, -1};
+
+void request_metrics_dump(int) {
+    char c = 'd';
+    ssize_t ignored = ::write(g_metrics_signal_pipe[1], &c, 1);
+    (void)ignored;
+}
+
+class MetricsExporter {
+public:
+    MetricsExporter() {}
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    ~MetricsExporter() { stop(); }
+
+    bool start(const std::string& path, std::string* error) {
+        if (pipe(g_metrics_signal_pipe) != 0) {
+            if (error) *error = std::string("pipe: ") + std::strerror(errno);
+            return false;
+        }
+        for (int fd : g_metrics_signal_pipe) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(g_metrics_signal_pipe[1], F_SETFL, O_NONBLOCK);
+        path_ = path;
+        thread_ = std::thread(&MetricsExporter::run, this);
+        // Restarted system calls keep a blocking read of stdin from failing
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = request_metrics_dump;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, nullptr);
+        return true;
+    }
+
+    // Writes the final dump and stops the thread
+    void stop() {
+        if (!thread_.joinable()) return;
+        signal(SIGUSR1, SIG_IGN);
+        char c = 'q';
+        ssize_t ignored = ::write(g_metrics_signal_pipe[1], &c, 1);
+        (void)ignored;
+        thread_.join();
+        for (int& fd : g_metrics_signal_pipe) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool dump() {
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        std::ofstream out(tmp, std::ios::trunc);
+        write_metrics(out);
+        out.close();
+        if (out && std::rename(tmp.c_str(), path_.c_str()) == 0) return true;
+        unlink(tmp.c_str());
+        return false;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            char c = 0;
+            ssize_t n = ::read(g_metrics_signal_pipe[0], &c, 1);
+            if (n < 0 && errno == EINTR) continue;
+            if (!dump()) std::cerr << "Cannot write metrics to " << path_ << std::endl;
+            if (n <= 0 || c == 'q') return;
+        }
+    }
+
+    std::string path_;
+    std::thread thread_;
+};
+
+MetricsExporter g_metrics_exporter;
+
+// Metrics go next to the progress store (progress.db -> metrics.prom)
+std::string metrics_path() {
+    size_t slash = g_store_path.find_last_of('/');
+    return (slash == std::string::npos) ? "metrics.prom" : g_store_path.substr(0, slash + 1) + "metrics.prom";
+}
+
+// --- Main Interactive Logic ---
+// The lesson screen outside challenge mode: the full lesson, or in review
+// mode just its title, summary and challenge
+void compose_lesson_frame(std::string& frame, const Localization& loc, const LessonView& current, const std::string& counter,
+                          bool review_mode, int due_reviews) {
+    if (review_mode) {
+        frame += "\033[1m" + loc.lesson_header + counter + ":\033[0m\n";
+        // Show only title (first line of explanation), summary, and challenge
+        std::string_view expl = current.explanation;
+        size_t pos = expl.find('\n');
+        std::string_view title = (pos != std::string_view::npos) ? expl.substr(0, pos) : expl;
+        std::string_view summary = (pos != std::string_view::npos) ? expl.substr(pos + 1) : std::string_view();
+        frame += "\033[1;34m";
+        frame += title;
+        frame += "\033[0m\n";
+        if (!summary.empty()) { frame += summary; frame += '\n'; }
+        frame += loc.challenge_header + "\n";
+        frame += current.challenge;
+        frame += "\n[review mode] Type next, back, repeat, exit to leave review\n";
+    } else {
+        frame += loc.lesson_header + counter + ":\n";
+        frame += current.explanation;
+        frame += '\n' + loc.code_header + '\n';
+        frame += current.code;
+        frame += '\n' + loc.challenge_header + '\n';
+        frame += current.challenge;
+        frame += '\n';
+        
+        // Show related lesson suggestion if available
+        if (!current.related_title.empty() && !current.related_level.empty()) {
+            frame += "\033[1;35m" + loc.related_topic + "\"";
+            frame += current.related_title;
+            frame += "\" from ";
+            frame += current.related_level;
+            frame += "\033[0m\n";
+        }
+        
+        frame += loc.commands_hint + '\n';
+        if (due_reviews > 0) frame += "\033[1;33m📚 " + std::to_string(due_reviews) + " review(s) due today: type due\033[0m\n";
+    }
+    frame += '\n' + loc.prompt_command;
+}
+
+// One learner session from resume/first-run prompts to exit
+int run_session() {
+    Progress progress;
+    progress.current_week = get_week_number();
+    progress.last_goal_date = get_current_date();
+    progress.last_seen_date = progress.last_goal_date;
+    Localization* loc = nullptr;  // until a language is known
+    // Keeps the catalog shown alive until the session moves to a newer one
+    std::shared_ptr<Localization> catalog;
+    // Transcript records report this session's state until it ends
+    struct BatchScope {
+        BatchScope(const Progress* p) { if (g_batch.active) g_batch.progress = p; }
+        ~BatchScope() { if (g_batch.active) { finish_batch_command(); g_batch.progress = nullptr; } }
+    } batch_scope(&progress);
+    bool in_review_mode = false;
+    bool instructor_mode_active = false;
+    ReviewSchedule reviews;
+    reviews.load(current_learner());
+
+    // --- Progress Load Option ---
+    bool has_progress = false;
+    Progress saved;
+    if (load_progress(saved)) {
+        has_progress = true;
+        // Check if date changed for daily goal
+        std::string today = get_current_date();
+        if (saved.last_goal_date != today) {
+            saved.daily_progress = 0;
+            saved.last_goal_date = today;
+        }
+        
+        // Check if week changed for weekly stats
+        int this_week = get_week_number();
+        if (saved.current_week != this_week) {
+            saved.weekly_lessons = 0;
+            saved.weekly_xp = 0;
+            saved.weekly_sessions = 0;
+            saved.current_week = this_week;
         }
         
-        lang = saved_lang;
-        level = saved_level;
-        lesson = saved_lesson;
-        xp = saved_xp;
-        bookmark = saved_bookmark;
-        daily_goal = saved_daily_goal;
-        daily_progress = saved_daily_progress;
-        last_goal_date = saved_last_goal_date;
-        total_lessons_completed = saved_total_lessons_completed;
-        total_xp = saved_total_xp;
-        sessions_count = saved_sessions_count + 1;
-        last_seen_date = today;
-        session_counter = saved_session_counter + 1;
-        weekly_sessions++;
-        weekly_lessons = saved_weekly_lessons;
-        weekly_xp = saved_weekly_xp;
-        weekly_sessions = saved_weekly_sessions;
-        current_week = saved_current_week;
+        progress = saved;
+        catalog = current_catalog(progress.lang);
+        loc = catalog.get();
+        progress.sessions_count++;
+        progress.last_seen_date = today;
+        progress.session_counter++;
+        progress.weekly_sessions++;
         
         // Show smart reminder
-        show_reminder(saved_last_seen_date, loc);
+        show_reminder(saved.last_seen_date, loc);
         
         // Automatic backup every 3 sessions
-        if (session_counter % 3 == 0) {
+        if (progress.session_counter % 3 == 0) {
             create_backup();
+            g_calendar.backups++;
             std::cout << "\033[32m" << loc->backup_created << "\033[0m\n";
         }
         
         // Weekly statistics every 7 sessions
-        if (session_counter % 7 == 0) {
-            display_weekly_stats(weekly_lessons, weekly_xp, weekly_sessions);
+        if (progress.session_counter % 7 == 0) {
+            g_calendar.weekly_summaries++;
+            display_weekly_stats(progress.weekly_lessons, progress.weekly_xp, progress.weekly_sessions);
             std::cout << "Press Enter to continue...";
-            std::cin.get();
+            wait_for_enter();
         }
     } else {
         // First run: ask for daily goal
         clear_screen();
         std::cout << "Set your daily lesson goal (default 3): ";
         std::string input_goal;
-        std::getline(std::cin, input_goal);
+        read_line(input_goal, "select");
         if (!input_goal.empty()) {
-            try { daily_goal = std::stoi(input_goal); } catch (...) { daily_goal = 3; }
+            try { progress.daily_goal = std::stoi(input_goal); } catch (...) { progress.daily_goal = 3; }
         }
-        last_goal_date = get_current_date();
-        last_seen_date = last_goal_date;
-        sessions_count = 1;
-        session_counter = 1;
-        current_week = get_week_number();
+        progress.last_goal_date = get_current_date();
+        progress.last_seen_date = progress.last_goal_date;
+        progress.sessions_count = 1;
+        progress.session_counter = 1;
+        progress.weekly_sessions = 1;
+        progress.current_week = get_week_number();
     }
 
     // --- Language Selection ---
-    if (!has_progress || (lang != 1 && lang != 2)) {
+    if (!has_progress || !find_locale(progress.lang)) {
         while (true) {
             clear_screen();
-            print_centered(loc->select_language);
+            print_centered(language_menu());
             std::string input;
-            std::getline(std::cin, input);
-            if (input == "1") { loc = &en; lang = 1; break; }
-            if (input == "2") { loc = &ar; lang = 2; break; }
+            if (!read_line(input, "select")) return 0;
+            if (int lang = language_choice(input)) {
+                progress.lang = lang;
+                catalog = current_catalog(progress.lang);
+                loc = catalog.get();
+                break;
+            }
         }
         
         // Show welcome message with typing animation
         clear_screen();
         type_text(loc->welcome_message, 30);
         std::cout << "\nPress Enter to continue...";
-        std::cin.get();
+        wait_for_enter();
     }
 
     // --- Level Selection ---
-    if (!has_progress || (level < 0 || level > 2)) {
+    if (!has_progress || (progress.level < 0 || progress.level >= level_count(*loc))) {
         while (true) {
             clear_screen();
             print_centered(loc->select_level);
             std::string input;
-            std::getline(std::cin, input);
-            if (input == "1") { level = 0; break; }
-            if (input == "2") { level = 1; break; }
-            if (input == "3") { level = 2; break; }
+            if (!read_line(input, "select")) return 0;
+            if (input == "1") { progress.level = 0; break; }
+            if (input == "2") { progress.level = 1; break; }
+            if (input == "3") { progress.level = 2; break; }
         }
     }
+    if (progress.level >= level_count(*loc)) progress.level = level_count(*loc) - 1;
 
     // --- Mode Selection ---
     bool challenge_mode = false;
     clear_screen();
     std::cout << "Choose a mode:\n1) Training Mode\n2) Challenge Mode\n";
     std::string mode_input;
-    std::getline(std::cin, mode_input);
+    read_line(mode_input, "select");
     if (mode_input == "2") challenge_mode = true;
 
     // --- Lesson Loop ---
-    int lesson_count = loc->levels[level].lessons.size();
     while (true) {
-        clear_screen();
+        // Between commands: take up a reloaded catalog, then re-read the
+        // level, since imports and edits can change it
+        if (refresh_catalog(catalog, progress)) loc = catalog.get();
+        int lesson_count = level_lesson_count(*loc, progress.level);
+        if (lesson_count == 0) {
+            std::cout << "This level has no lessons." << '\n';
+            break;
+        }
+        if (progress.lesson >= lesson_count) progress.lesson = lesson_count - 1;
+        if (progress.lesson < 0) progress.lesson = 0;
+        LessonView current = lesson_view(*loc, progress.level, progress.lesson);
+        std::string counter = std::to_string(progress.lesson + 1) + "/" + std::to_string(lesson_count);
+        auto render_started = std::chrono::steady_clock::now();
+        std::string& frame = screen().begin_frame();
         if (challenge_mode) {
-            type_text("\033[1m" + loc->lesson_header + std::to_string(lesson + 1) + "/" + std::to_string(lesson_count) + ":\033[0m", 20);
-            type_text(loc->challenge_header, 15);
-            std::cout << loc->levels[level].lessons[lesson].challenge << std::endl;
-            std::cout << "Type your answer (or type skip/back/exit): ";
+            frame += "\033[1m" + loc->lesson_header + counter + ":\033[0m\n";
+            frame += loc->challenge_header + "\n";
+            frame += current.challenge;
+            frame += "\nType your answer (or type skip/back/exit): ";
+            screen().present();
+            phase_metric(Phase::Render).record(std::chrono::steady_clock::now() - render_started);
             std::string answer;
-            std::getline(std::cin, answer);
-            if (answer == "exit") break;
-            if (answer == "back") { if (lesson > 0) lesson--; continue; }
-            if (answer == "skip") { if (lesson < lesson_count - 1) lesson++; continue; }
-            // Compare answer (case-insensitive, trimmed)
-            std::string correct = loc->levels[level].lessons[lesson].solution;
-            auto trim = [](std::string s) { size_t f = s.find_first_not_of(" \t\n\r"); size_t l = s.find_last_not_of(" \t\n\r"); return (f == std::string::npos) ? "" : s.substr(f, l - f + 1); };
-            auto lower = [](std::string s) { for (auto& c : s) c = tolower(c); return s; };
-            if (lower(trim(answer)) == lower(trim(correct))) {
-                xp += 10;
-                daily_progress++;
-                total_xp += 10;
-                total_lessons_completed++;
-                weekly_xp += 10;
-                weekly_lessons++;
-                std::cout << "\033[32m✅ Correct! You earned 10 XP! Total: " << xp << "\033[0m\n";
+            auto asked = std::chrono::steady_clock::now();
+            bool answered = read_line(answer, "answer");
+            phase_metric(Phase::Input).record(std::chrono::steady_clock::now() - asked);
+            if (!answered || answer == "exit") break;
+            if (answer == "back") { if (progress.lesson > 0) progress.lesson--; continue; }
+            if (answer == "skip") {
+                record_event(EventKind::Skip, progress.lang, progress.level, progress.lesson);
+                if (progress.lesson < lesson_count - 1) progress.lesson++;
+                continue;
+            }
+            // Compare answer against the precompiled key (normalized, typo-tolerant)
+            std::string correct(current.solution);
+            int distance = 0;
+            bool passed = answer_key(*loc, progress.level, progress.lesson).accepts(answer, &distance);
+            uint32_t answer_ms = elapsed_ms(asked);
+            record_event(EventKind::ChallengeAnswer, progress.lang, progress.level, progress.lesson, passed, answer_ms);
+            reviews.grade(progress.lang, progress.level, progress.lesson, review_quality(passed, distance, answer_ms), local_day(clock_now()));
+            if (passed) {
+                progress.xp += 10;
+                progress.daily_progress++;
+                progress.total_xp += 10;
+                progress.total_lessons_completed++;
+                progress.weekly_xp += 10;
+                progress.weekly_lessons++;
+                std::cout << "\033[32m✅ Correct! You earned 10 XP! Total: " << progress.xp << "\033[0m\n";
+                if (distance > 0) std::cout << "(Close enough. Exact solution: " << correct << ")\n";
             } else {
                 std::cout << "\033[31m❌ Incorrect.\033[0m\n";
-                std::cout << "Solution: " << correct << std::endl;
+                std::cout << "Solution: " << correct << '\n';
             }
-            std::cout << "\033[33m✅ You've completed " << daily_progress << "/" << daily_goal << " of your daily goal!\033[0m\n";
-            if (daily_progress >= daily_goal) {
+            std::cout << "\033[33m✅ You've completed " << progress.daily_progress << "/" << progress.daily_goal << " of your daily goal!\033[0m\n";
+            if (progress.daily_progress >= progress.daily_goal) {
                 std::cout << "\033[32m🎉 Daily goal achieved! You’re crushing it!\033[0m\n";
             }
-            std::cin.get();
-            if (lesson < lesson_count - 1) lesson++;
-            save_progress(lang, level, lesson, xp, bookmark, daily_goal, daily_progress, last_goal_date, total_lessons_completed, total_xp, sessions_count, last_seen_date, session_counter, weekly_lessons, weekly_xp, weekly_sessions, current_week);
+            wait_for_enter();
+            if (progress.lesson < lesson_count - 1) progress.lesson++;
+            save_progress(progress);
             continue;
         }
-        if (in_review_mode) {
-            type_text("\033[1m" + loc->lesson_header + std::to_string(lesson + 1) + "/" + std::to_string(lesson_count) + ":\033[0m", 20);
-            // Show only title (first line of explanation), summary, and challenge
-            std::string expl = loc->levels[level].lessons[lesson].explanation;
-            size_t pos = expl.find('\n');
-            std::string title = (pos != std::string::npos) ? expl.substr(0, pos) : expl;
-            std::string summary = (pos != std::string::npos) ? expl.substr(pos + 1) : "";
-            std::cout << "\033[1;34m" << title << "\033[0m\n";
-            if (!summary.empty()) std::cout << summary << "\n";
-            type_text(loc->challenge_header, 15);
-            std::cout << loc->levels[level].lessons[lesson].challenge << std::endl;
-            std::cout << "[review mode] Type next, back, repeat, exit to leave review\n";
-        } else {
-            type_text(loc->lesson_header + std::to_string(lesson + 1) + "/" + std::to_string(lesson_count) + ":", 20);
-            std::cout << loc->levels[level].lessons[lesson].explanation << std::endl;
-            type_text(loc->code_header, 15);
-            std::cout << loc->levels[level].lessons[lesson].code << std::endl;
-            type_text(loc->challenge_header, 15);
-            std::cout << loc->levels[level].lessons[lesson].challenge << std::endl;
-            
-            // Show related lesson suggestion if available
-            if (!loc->levels[level].lessons[lesson].related_title.empty() && !loc->levels[level].lessons[lesson].related_level.empty()) {
-                std::cout << "\033[1;35m" << loc->related_topic << "\"" << loc->levels[level].lessons[lesson].related_title << "\" from " << loc->levels[level].lessons[lesson].related_level << "\033[0m\n";
-            }
-            
-            std::cout << loc->commands_hint << std::endl;
-        }
-        std::cout << std::endl << loc->prompt_command;
+        int due = in_review_mode ? 0 : reviews.due_count(progress.lang, local_day(clock_now()));
+        compose_lesson_frame(frame, *loc, current, counter, in_review_mode, due);
+        screen().present();
+        auto prompted = std::chrono::steady_clock::now();
+        phase_metric(Phase::Render).record(prompted - render_started);
         std::string input;
-        std::getline(std::cin, input);
-        // Import command
-        if ((lang == 2 && input == "استيراد") || (lang == 1 && input == "import")) {
-            std::cout << "Enter filename to import: ";
-            std::string fname;
-            std::getline(std::cin, fname);
-            if (import_lesson(fname, loc->levels[level])) {
-                std::cout << "\033[32mLesson imported successfully!\033[0m\n";
-            } else {
-                std::cout << "\033[31mFailed to import lesson.\033[0m\n";
-            }
-            std::cin.get();
-            continue;
-        }
+        bool got_input = read_line(input);
+        auto dispatched = std::chrono::steady_clock::now();
+        phase_metric(Phase::Input).record(dispatched - prompted);
+        if (!got_input) break;
         // Save progress after each lesson
-        save_progress(lang, level, lesson, xp, bookmark, daily_goal, daily_progress, last_goal_date, total_lessons_completed, total_xp, sessions_count, last_seen_date, session_counter, weekly_lessons, weekly_xp, weekly_sessions, current_week);
-        if (lang == 2) {
-            // Arabic commands
-            if (input == "مراجعة") { in_review_mode = true; continue; }
-            if (in_review_mode) {
-                if (input == "التالي") {
-                    if (lesson < lesson_count - 1) {
-                        lesson++;
-                        xp += 10;
-                        daily_progress++;
-                        total_xp += 10;
-                        total_lessons_completed++;
-                        weekly_xp += 10;
-                        weekly_lessons++;
-                        std::cout << "\033[32m✅ لقد حصلت على 10 نقطة خبرة! المجموع: " << xp << "\033[0m\n";
-                        std::cout << "\033[33m✅ أنجزت " << daily_progress << "/" << daily_goal << " من هدفك اليومي!\033[0m\n";
-                        if (daily_progress >= daily_goal) {
-                            std::cout << "\033[32m🎉 لقد حققت هدفك اليومي! أنت رائع!\033[0m\n";
-                        }
-                        std::cin.get();
-                    } else { std::cout << loc->next_last << std::endl; std::cin.get(); }
-                } else if (input == "السابق") {
-                    if (lesson > 0) lesson--;
-                    else { std::cout << loc->back_first << std::endl; std::cin.get(); }
-                } else if (input == "إعادة") {
-                    continue;
-                } else if (input == "خروج") {
-                    in_review_mode = false;
-                    continue;
-                }
+        save_progress(progress);
+        CommandContext context{progress, loc, current, lesson_count, in_review_mode, instructor_mode_active, reviews, {}};
+        Command command = parse_command(input, &context.args);
+        CommandResult result = kCommandHandlers[(size_t)command](context);
+        auto handled = std::chrono::steady_clock::now() - dispatched;
+        phase_metric(Phase::Dispatch).record(handled);
+        g_metrics.commands[(size_t)command].record(handled);
+        if (result == CommandResult::Quit) break;
+        if (result == CommandResult::Redraw) continue;
+        // End-of-level evaluation and quiz
+        if (!in_review_mode && !challenge_mode && progress.lesson == lesson_count - 1) {
+            type_text("\033[1;35m🎓 Level Completed: " + loc->levels[progress.level].name + "\033[0m", 25);
+            type_text("✅ You answered " + std::to_string(lesson_count) + "/" + std::to_string(lesson_count) + " challenges", 20);
+            type_text("🎯 XP Earned: " + std::to_string(progress.xp), 20);
+            type_text("🏆 Great progress!", 20);
+            std::cout << "\nPress Enter to take the end-of-level quiz...\n";
+            wait_for_enter();
+            run_end_of_level_quiz(*loc, progress.lang, progress.level, reviews, progress.xp, progress.total_xp);
+            std::cout << "\nType retry to repeat the level, or next to proceed: ";
+            std::string end_input;
+            read_line(end_input, "select");
+            if (end_input == "retry") { progress.lesson = 0; continue; }
+            if (end_input == "next") break;
+        }
+    }
+    save_progress(progress);
+    return 0;
+}
+
+// --- Simulation ---
+// ./learn --simulate <learners> <days> [--from YYYY-MM-DD] runs synthetic
+// learners through that many days of sessions on the virtual clock, against
+// real stores (simulation/progress.db unless --store is given). Each learner
+// has its own activity rate, accuracy, pace and language. Sessions start at
+// random local times, including just after and just before midnight. After
+// each session the saved progress is checked against the simulation's own
+// schedule: last-seen date, daily and weekly resets, and whether a reminder,
+// backup or weekly summary came due. The report lists any mismatch, the
+// calendar boundaries crossed (weeks, years, DST changes) and how the stores
+// held up (session latency, file sizes, backup volume).
+struct SimLearner {
+    std::string id;
+    double activity = 0;  // chance of a session on any day
+    double accuracy = 0;  // chance of answering correctly
+    int pace = 1;         // most answers per session
+    int lang = 1;
+    bool started = false;
+    int64_t last_day = 0;
+    int64_t last_monday = 0;
+};
+
+// Local midnight-relative time on a day; times DST skips move forward
+int64_t sim_local_time(int64_t day, int minute_of_day) {
+    int y, m, d;
+    civil_from_days(day, y, m, d);
+    tm local = {};
+    local.tm_year = y - 1900;
+    local.tm_mon = m - 1;
+    local.tm_mday = d;
+    local.tm_hour = minute_of_day / 60;
+    local.tm_min = minute_of_day % 60;
+    local.tm_isdst = -1;
+    return (int64_t)mktime(&local);
+}
+
+int run_simulation(int learner_count, int days, const std::string& from) {
+    int64_t start_day = local_day((int64_t)time(nullptr));
+    if (!from.empty() && !parse_date(from, start_day)) {
+        std::cerr << "--from needs a date as YYYY-MM-DD" << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<SimLearner> learners(learner_count);
+    for (int i = 0; i < learner_count; ++i) {
+        char id[32];
+        snprintf(id, sizeof(id), "sim-%05d", i);
+        SimLearner& l = learners[i];
+        l.id = id;
+        l.activity = 0.1 + 0.85 * unit(rng);
+        l.accuracy = 0.3 + 0.65 * unit(rng);
+        l.pace = 1 + (int)(rng() % 5);
+        // Most learners take the first language; the rest share the others
+        double pick = unit(rng);
+        size_t which = 0;
+        if (pick >= 0.7 && kLocaleCount > 1) which = 1 + std::min(kLocaleCount - 2, (size_t)((pick - 0.7) / 0.3 * (kLocaleCount - 1)));
+        l.lang = kLocales[which].id;
+    }
+
+    std::map<std::string, uint64_t> anomalies;
+    std::map<std::string, std::string> first_example;
+    auto anomaly = [&](const std::string& what, const SimLearner& l, int64_t day, const std::string& detail) {
+        if (anomalies[what]++ == 0) first_example[what] = l.id + " on " + format_date(day) + ": " + detail;
+    };
+    uint64_t expected_reminders = 0, expected_backups = 0, expected_summaries = 0;
+    std::vector<double> session_us;
+    int year_changes = 0, dst_changes = 0;
+
+    NullBuffer null_buffer;
+    std::ostream null_transcript(&null_buffer);
+    std::streambuf* console = std::cout.rdbuf();
+    std::cout.rdbuf(&null_buffer);
+    g_batch.transcript = &null_transcript;
+    std::string saved_learner = g_learner_id;
+    auto started = std::chrono::steady_clock::now();
+    for (int n = 0; n < days; ++n) {
+        int64_t today = start_day + n;
+        std::string today_text = format_date(today);
+        int y, m, d;
+        civil_from_days(today, y, m, d);
+        if (n > 0 && m == 1 && d == 1) ++year_changes;
+        if (n > 0) {
+            time_t noon_before = (time_t)sim_local_time(today - 1, 12 * 60), noon = (time_t)sim_local_time(today, 12 * 60);
+            tm a, b;
+            localtime_r(&noon_before, &a);
+            localtime_r(&noon, &b);
+            if (a.tm_isdst != b.tm_isdst) ++dst_changes;
+        }
+        // Today's sessions in time order
+        std::vector<std::pair<int, int>> sessions;  // minute of day, learner
+        for (int i = 0; i < learner_count; ++i) {
+            if (unit(rng) >= learners[i].activity) continue;
+            double r = unit(rng);
+            int minute = r < 0.1 ? (int)(rng() % 60) : r < 0.2 ? 23 * 60 + (int)(rng() % 60) : 6 * 60 + (int)(rng() % (17 * 60));
+            sessions.emplace_back(minute, i);
+        }
+        std::sort(sessions.begin(), sessions.end());
+        for (const auto& session : sessions) {
+            SimLearner& l = learners[session.second];
+            g_learner_id = l.id;
+            g_virtual_time.store(sim_local_time(today, session.first));
+            if (local_day(clock_now()) != today) {
+                anomaly("virtual time lands on another day", l, today, "minute " + std::to_string(session.first));
+                continue;
             }
-            if (input == "التالي") {
-                if (lesson < lesson_count - 1) {
-                    lesson++;
-                    xp += 10;
-                    daily_progress++;
-                    total_xp += 10;
-                    total_lessons_completed++;
-                    std::cout << "\033[32m✅ لقد حصلت على 10 نقطة خبرة! المجموع: " << xp << "\033[0m\n";
-                    std::cout << "\033[33m✅ أنجزت " << daily_progress << "/" << daily_goal << " من هدفك اليومي!\033[0m\n";
-                    if (daily_progress >= daily_goal) {
-                        std::cout << "\033[32m🎉 لقد حققت هدفك اليومي! أنت رائع!\033[0m\n";
-                    }
-                    std::cin.get();
-                } else { std::cout << loc->next_last << std::endl; std::cin.get(); }
-            } else if (input == "السابق") {
-                if (lesson > 0) lesson--;
-                else { std::cout << loc->back_first << std::endl; std::cin.get(); }
-            } else if (input == "إعادة") {
+            Progress before;
+            bool had = load_progress(before);
+            if (had != l.started) anomaly("saved progress appeared or vanished", l, today, had ? "found" : "missing");
+            const Localization& loc = *catalog_for(had ? before.lang : l.lang);
+            int level = had ? before.level : 0;
+            int lesson = had ? before.lesson : 0;
+            int last = level_lesson_count(loc, level) - 1;
+
+            g_batch.script.clear();
+            if (!had) {
+                g_batch.script = {"3", std::to_string(l.lang), "1"};
+            }
+            g_batch.script.push_back("2");  // challenge mode
+            int answers = 1 + (int)(rng() % l.pace), correct = 0;
+            for (int a = 0; a < answers; ++a) {
+                bool right = unit(rng) < l.accuracy;
+                correct += right;
+                g_batch.script.push_back(right ? std::string(lesson_view(loc, level, std::min(lesson + a, last)).solution) : "no idea");
+            }
+            g_batch.script.push_back("exit");
+            g_batch.next = 0;
+
+            // What the calendar logic should do in this session
+            time_t now = (time_t)clock_now();
+            tm local;
+            localtime_r(&now, &local);
+            int64_t monday = today - (local.tm_wday + 6) % 7;
+            int counter = had ? before.session_counter + 1 : 1;
+            bool reminder = had && today - l.last_day > 2;
+            bool backup = had && counter % 3 == 0;
+            bool summary = had && counter % 7 == 0;
+            uint64_t reminders = g_calendar.reminders, backups = g_calendar.backups, summaries = g_calendar.weekly_summaries;
+            expected_reminders += reminder;
+            expected_backups += backup;
+            expected_summaries += summary;
+
+            auto session_started = std::chrono::steady_clock::now();
+            run_session();
+            session_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - session_started).count());
+
+            if ((g_calendar.reminders - reminders == 1) != reminder) anomaly(reminder ? "reminder missing" : "unexpected reminder", l, today, std::to_string(today - l.last_day) + " day(s) since last session");
+            if ((g_calendar.backups - backups == 1) != backup) anomaly(backup ? "backup missing" : "unexpected backup", l, today, "session " + std::to_string(counter));
+            if ((g_calendar.weekly_summaries - summaries == 1) != summary) anomaly(summary ? "weekly summary missing" : "unexpected weekly summary", l, today, "session " + std::to_string(counter));
+            Progress after;
+            if (!load_progress(after)) {
+                anomaly("progress not saved", l, today, "no record after the session");
                 continue;
-            } else if (input == "الكود") {
-                clear_screen();
-                type_text(loc->code_header, 15);
-                std::cout << loc->levels[level].lessons[lesson].code << std::endl;
-                std::cin.get();
-            } else if (input == "الحل") {
-                clear_screen();
-                type_text(loc->solution_header, 15);
-                std::cout << loc->levels[level].lessons[lesson].solution << std::endl;
-                std::cin.get();
-            } else if (input == "ملاحظة") {
-                std::cout << loc->note_prompt;
-                std::string note;
-                std::getline(std::cin, note);
-                save_note(lang, level, lesson, note);
-                std::cout << "\033[32m" << loc->note_saved << "\033[0m\n";
-                std::cin.get();
-            } else if (input == "ملاحظات") {
-                display_notes();
-                std::cin.get();
-            } else if (input == "علامة") {
-                bookmark = lesson;
-                std::cout << "\033[32m" << loc->bookmark_saved << (lesson + 1) << "\033[0m\n";
-                std::cin.get();
-            } else if (input == "اذهب") {
-                if (bookmark >= 0 && bookmark < lesson_count) {
-                    lesson = bookmark;
-                    std::cout << "\033[32m" << loc->bookmark_loaded << (lesson + 1) << "\033[0m\n";
-                } else {
-                    std::cout << "\033[31m❌ No bookmark set!\033[0m\n";
-                }
-                std::cin.get();
-            } else if (input == "وضع") {
-                if (instructor_mode_edit(loc, level, lesson)) {
-                    instructor_mode_active = true;
-                }
-                std::cin.get();
-            } else if (input == "خروج") {
-                std::cout << loc->goodbye << std::endl;
+            }
+            bool same_day = had && before.last_goal_date == today_text;
+            bool same_week = had && l.last_monday == monday;
+            if (after.last_seen_date != today_text) anomaly("wrong last-seen date", l, today, after.last_seen_date);
+            if (after.last_goal_date != today_text) anomaly("wrong daily goal date", l, today, after.last_goal_date);
+            if (after.daily_progress != (same_day ? before.daily_progress : 0) + correct) {
+                anomaly(same_day ? "daily progress lost" : "daily progress not reset", l, today, std::to_string(after.daily_progress));
+            }
+            if (after.weekly_sessions != (same_week ? before.weekly_sessions : 0) + 1) {
+                anomaly(same_week ? "weekly sessions lost" : "weekly sessions not reset", l, today, std::to_string(after.weekly_sessions));
+            }
+            if (after.weekly_lessons != (same_week ? before.weekly_lessons : 0) + correct) {
+                anomaly(same_week ? "weekly lessons lost" : "weekly lessons not reset", l, today, std::to_string(after.weekly_lessons));
+            }
+            if (after.session_counter != counter) anomaly("session counter off", l, today, std::to_string(after.session_counter));
+            l.started = true;
+            l.last_day = today;
+            l.last_monday = monday;
+        }
+    }
+    g_snapshots.stop();
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    g_virtual_time.store(-1);
+    g_learner_id = saved_learner;
+    g_batch.transcript = nullptr;
+    std::cout.rdbuf(console);
+
+    auto file_size = [](const std::string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+    };
+    std::sort(session_us.begin(), session_us.end());
+    auto pct = [&session_us](double p) { return session_us.empty() ? 0.0 : session_us[(size_t)((session_us.size() - 1) * p)]; };
+    std::cout << std::fixed << std::setprecision(1)
+              << "Simulated " << learner_count << " learner(s) over " << days << " day(s) from " << format_date(start_day)
+              << ": " << session_us.size() << " session(s) in " << elapsed_s << " s\n"
+              << "Calendar: " << (days + 6) / 7 << " week(s), " << year_changes << " new year(s), " << dst_changes << " DST change(s)\n"
+              << "Reminders " << g_calendar.reminders << "/" << expected_reminders
+              << ", backups " << g_calendar.backups << "/" << expected_backups
+              << ", weekly summaries " << g_calendar.weekly_summaries << "/" << expected_summaries << " (seen/expected)\n"
+              << "Session time: p50 " << pct(0.5) << " us, p99 " << pct(0.99) << " us, max " << pct(1.0) << " us\n"
+              << "Store " << file_size(g_store_path) << " bytes, journal " << file_size(g_store_path + ".journal")
+              << " bytes; " << g_snapshots.taken() << " snapshot(s) wrote " << g_snapshots.bytes_written() << " bytes in total\n";
+    if (anomalies.empty()) {
+        std::cout << "No anomalies.\n";
+        return 0;
+    }
+    std::cout << "Anomalies:\n";
+    for (const auto& entry : anomalies) {
+        std::cout << "  " << entry.first << ": " << entry.second << " (first: " << first_example[entry.first] << ")\n";
+    }
+    return 2;
+}
+
+// --- Learning Server ---
+// --serve <socket> loads the catalogs and opens the shared stores once, then
+// serves many learners over a Unix domain socket. The accepting thread hands
+// each connection to one of a few workers (--workers). Each worker runs an
+// epoll loop over its connections with non-blocking input and output buffers.
+// It runs each learner's run_session() as a coroutine that is suspended
+// whenever the session waits for a line, so a blocked learner costs a stack,
+// not a thread. --connect <socket> is the thin client.
+//
+// Protocol: the client's first line is "LEARN 1 <learner-id>"; after that the
+// connection carries plain terminal text in both directions.
+const char* const kServeGreeting = "LEARN 1 ";
+
+// Sends everything or fails (client side and error replies)
+bool send_all(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t put = ::send(fd, data, n, MSG_NOSIGNAL);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        data += put;
+        n -= (size_t)put;
+    }
+    return true;
+}
+
+bool unix_address(const std::string& path, sockaddr_un& addr, std::string* error) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        if (error) *error = "socket path must be 1-" + std::to_string(sizeof(addr.sun_path) - 1) + " bytes: " + path;
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// Thin client: relays the terminal to a server session until either side hangs up
+int run_client(const std::string& path, const std::string& learner) {
+    sockaddr_un addr;
+    std::string error;
+    if (!unix_address(path, addr, &error)) { std::cerr << error << std::endl; return 1; }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        std::cerr << "Cannot connect to " << path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) ::close(fd);
+        return 1;
+    }
+    std::string hello = kServeGreeting + learner + "\n";
+    send_all(fd, hello.data(), hello.size());
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+    char buf[4096];
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) {
+            ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            write_stdout(buf, (size_t)n);
+        }
+        if (fds[0].revents) {
+            ssize_t n = ::read(STDIN_FILENO, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                // No more input: let the session end, keep showing its output
+                ::shutdown(fd, SHUT_WR);
+                fds[0].fd = -1;
+            } else if (!send_all(fd, buf, (size_t)n)) {
                 break;
-            } else {
-                std::cout << loc->invalid_command << std::endl;
-                std::cin.get();
             }
-        } else {
-            // English commands
-            if (input == "review") { in_review_mode = true; continue; }
-            if (in_review_mode) {
-                if (input == "next") {
-                    if (lesson < lesson_count - 1) {
-                        lesson++;
-                        xp += 10;
-                        daily_progress++;
-                        total_xp += 10;
-                        total_lessons_completed++;
-                        weekly_xp += 10;
-                        weekly_lessons++;
-                        std::cout << "\033[32m✅ You earned 10 XP! Total: " << xp << "\033[0m\n";
-                        std::cout << "\033[33m✅ You've completed " << daily_progress << "/" << daily_goal << " of your daily goal!\033[0m\n";
-                        if (daily_progress >= daily_goal) {
-                            std::cout << "\033[32m🎉 Daily goal achieved! You’re crushing it!\033[0m\n";
-                        }
-                        std::cin.get();
-                    } else { std::cout << loc->next_last << std::endl; std::cin.get(); }
-                } else if (input == "back") {
-                    if (lesson > 0) lesson--;
-                    else { std::cout << loc->back_first << std::endl; std::cin.get(); }
-                } else if (input == "repeat") {
-                    continue;
-                } else if (input == "exit") {
-                    in_review_mode = false;
+        }
+    }
+    ::close(fd);
+    return 0;
+}
+
+#if defined(__linux__)
+const size_t kSessionStackSize = 256 * 1024;
+const size_t kSessionInputMax = 64 * 1024;      // a longer line drops the connection
+const size_t kSessionOutputHighWater = 1 << 20;  // stop running a session the client isn't reading
+
+// Routes std::cout to the running session's buffer on worker threads
+class SessionOutputBuffer : public std::streambuf {
+public:
+    explicit SessionOutputBuffer(std::streambuf* fallback) : fallback_(fallback) {}
+
+protected:
+    int overflow(int c) override {
+        if (c == traits_type::eof()) return traits_type::not_eof(c);
+        if (t_session) {
+            t_session->output.push_back((char)c);
+            return c;
+        }
+        return fallback_->sputc((char)c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        if (t_session) {
+            t_session->output.append(s, (size_t)n);
+            return n;
+        }
+        return fallback_->sputn(s, n);
+    }
+
+    int sync() override { return t_session ? 0 : fallback_->pubsync(); }
+
+private:
+    std::streambuf* fallback_;
+};
+
+// One connection: socket buffers plus the coroutine running its session
+class ServedSession : public SessionContext {
+public:
+    ServedSession(int fd, ucontext_t* scheduler) : fd_(fd), scheduler_(scheduler) {}
+    ServedSession(const ServedSession&) = delete;
+    ServedSession& operator=(const ServedSession&) = delete;
+
+    ~ServedSession() {
+        if (stack_ != MAP_FAILED) munmap(stack_, kSessionStackSize);
+        ::close(fd_);
+    }
+
+    // Maps the coroutine stack (with a guard page below it) and prepares the entry
+    bool start() {
+        stack_ = mmap(nullptr, kSessionStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (stack_ == MAP_FAILED) return false;
+        mprotect(stack_, sysconf(_SC_PAGESIZE), PROT_NONE);
+        getcontext(&context_);
+        context_.uc_stack.ss_sp = stack_;
+        context_.uc_stack.ss_size = kSessionStackSize;
+        context_.uc_link = scheduler_;
+        makecontext(&context_, &ServedSession::entry, 0);
+        return true;
+    }
+
+    int fd() const { return fd_; }
+    bool finished() const { return finished_; }
+
+    // Worth resuming: a line (or the hangup) the session is waiting for has arrived
+    bool runnable() const {
+        if (finished_ || output.size() >= kSessionOutputHighWater) return false;
+        return !started_ || hangup_ || input_.find('\n', scanned_) != std::string::npos;
+    }
+
+    // Runs the session on this thread until it waits for input or ends
+    void resume() {
+        started_ = true;
+        t_session = this;
+        swapcontext(scheduler_, &context_);
+        t_session = nullptr;
+    }
+
+    // Reads whatever the socket has; false once the connection is unusable
+    bool receive() {
+        char buf[4096];
+        for (;;) {
+            ssize_t n = ::read(fd_, buf, sizeof(buf));
+            if (n > 0) {
+                input_.append(buf, (size_t)n);
+                if (input_.size() > kSessionInputMax) return false;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            hangup_ = true;
+            return true;
+        }
+    }
+
+    // Writes as much buffered output as the socket takes; false on a dead peer
+    bool flush() {
+        size_t done = 0;
+        while (done < output.size()) {
+            ssize_t n = ::send(fd_, output.data() + done, output.size() - done, MSG_NOSIGNAL);
+            if (n > 0) { done += (size_t)n; continue; }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            output.clear();
+            return false;
+        }
+        output.erase(0, done);
+        return true;
+    }
+
+    void hang_up() { hangup_ = true; }
+
+    bool read_line(std::string& out) override {
+        for (;;) {
+            size_t end = input_.find('\n', scanned_);
+            if (end != std::string::npos) {
+                out.assign(input_, 0, end);
+                if (!out.empty() && out.back() == '\r') out.pop_back();
+                input_.erase(0, end + 1);
+                scanned_ = 0;
+                return true;
+            }
+            scanned_ = input_.size();
+            if (hangup_) return false;
+            swapcontext(&context_, scheduler_);
+        }
+    }
+
+private:
+    static void entry() {
+        ServedSession* self = static_cast<ServedSession*>(t_session);
+        self->run();
+        self->finished_ = true;
+    }
+
+    void run() {
+        std::string hello;
+        if (!read_line(hello)) return;
+        size_t prefix = std::strlen(kServeGreeting);
+        learner_id = hello.compare(0, prefix, kServeGreeting) == 0 ? hello.substr(prefix) : "";
+        if (learner_id.empty() || learner_id.size() > kLearnerIdMax) {
+            std::cout << "ERROR expected \"" << kServeGreeting << "<learner-id>\" (1-" << kLearnerIdMax << " bytes)\n";
+            return;
+        }
+        try {
+            run_session();
+        } catch (const std::exception& e) {
+            std::cerr << "Session for " << learner_id << " failed: " << e.what() << std::endl;
+        }
+    }
+
+    int fd_;
+    ucontext_t* scheduler_;
+    ucontext_t context_;
+    void* stack_ = MAP_FAILED;
+    std::string input_;
+    size_t scanned_ = 0;  // input_ before this offset has no newline
+    bool started_ = false;
+    bool hangup_ = false;
+    bool finished_ = false;
+};
+
+class ServerWorker {
+public:
+    ServerWorker() {}
+    ServerWorker(const ServerWorker&) = delete;
+    ServerWorker& operator=(const ServerWorker&) = delete;
+    ~ServerWorker() { stop(); }
+
+    bool start(std::string* error) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0) {
+            if (error) *error = std::string("cannot create worker event loop: ") + std::strerror(errno);
+            return false;
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+        thread_ = std::thread(&ServerWorker::run, this);
+        return true;
+    }
+
+    // Called by the acceptor; the worker owns fd from here on
+    void adopt(int fd) {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            incoming_.push_back(fd);
+        }
+        wake();
+    }
+
+    // Hangs up every session (each saves its progress) and joins the thread
+    void stop() {
+        if (thread_.joinable()) {
+            stopping_.store(true);
+            wake();
+            thread_.join();
+        }
+        if (epoll_fd_ >= 0) ::close(epoll_fd_);
+        if (wake_fd_ >= 0) ::close(wake_fd_);
+        epoll_fd_ = wake_fd_ = -1;
+    }
+
+private:
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void run() {
+        epoll_event events[64];
+        for (;;) {
+            int n = epoll_wait(epoll_fd_, events, 64, -1);
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; ++i) {
+                ServedSession* s = static_cast<ServedSession*>(events[i].data.ptr);
+                if (!s) {
+                    uint64_t count;
+                    ssize_t ignored = ::read(wake_fd_, &count, sizeof(count));
+                    (void)ignored;
+                    take_incoming();
                     continue;
                 }
+                bool ok = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) ok = s->receive();
+                pump(s, ok);
             }
-            if (input == "next") {
-                if (lesson < lesson_count - 1) {
-                    lesson++;
-                    xp += 10;
-                    daily_progress++;
-                    total_xp += 10;
-                    total_lessons_completed++;
-                    weekly_xp += 10;
-                    weekly_lessons++;
-                    std::cout << "\033[32m✅ You earned 10 XP! Total: " << xp << "\033[0m\n";
-                    std::cout << "\033[33m✅ You've completed " << daily_progress << "/" << daily_goal << " of your daily goal!\033[0m\n";
-                    if (daily_progress >= daily_goal) {
-                        std::cout << "\033[32m🎉 Daily goal achieved! You’re crushing it!\033[0m\n";
-                    }
-                    std::cin.get();
-                } else { std::cout << loc->next_last << std::endl; std::cin.get(); }
-            } else if (input == "back") {
-                if (lesson > 0) lesson--;
-                else { std::cout << loc->back_first << std::endl; std::cin.get(); }
-            } else if (input == "repeat") {
-                continue;
-            } else if (input == "code") {
-                clear_screen();
-                type_text(loc->code_header, 15);
-                std::cout << loc->levels[level].lessons[lesson].code << std::endl;
-                std::cin.get();
-            } else if (input == "solution") {
-                clear_screen();
-                type_text(loc->solution_header, 15);
-                std::cout << loc->levels[level].lessons[lesson].solution << std::endl;
-                std::cin.get();
-            } else if (input == "note") {
-                std::cout << loc->note_prompt;
-                std::string note;
-                std::getline(std::cin, note);
-                save_note(lang, level, lesson, note);
-                std::cout << "\033[32m" << loc->note_saved << "\033[0m\n";
-                std::cin.get();
-            } else if (input == "notes") {
-                display_notes();
-                std::cin.get();
-            } else if (input == "bookmark") {
-                bookmark = lesson;
-                std::cout << "\033[32m" << loc->bookmark_saved << (lesson + 1) << "\033[0m\n";
-                std::cin.get();
-            } else if (input == "goto") {
-                if (bookmark >= 0 && bookmark < lesson_count) {
-                    lesson = bookmark;
-                    std::cout << "\033[32m" << loc->bookmark_loaded << (lesson + 1) << "\033[0m\n";
-                } else {
-                    std::cout << "\033[31m❌ No bookmark set!\033[0m\n";
-                }
-                std::cin.get();
-            } else if (input == "mode") {
-                if (instructor_mode_edit(loc, level, lesson)) {
-                    instructor_mode_active = true;
+            if (stopping_.load()) {
+                std::vector<ServedSession*> all;
+                for (auto& entry : sessions_) all.push_back(entry.second.get());
+                for (ServedSession* s : all) {
+                    s->hang_up();
+                    pump(s, true);
                 }
-                std::cin.get();
-            } else if (input == "exit") {
-                std::cout << loc->goodbye << std::endl;
+                return;
+            }
+        }
+    }
+
+    void take_incoming() {
+        std::vector<int> fds;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            fds.swap(incoming_);
+        }
+        for (int fd : fds) {
+            std::unique_ptr<ServedSession> s(new ServedSession(fd, &scheduler_));
+            if (!s->start()) continue;
+            epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.ptr = s.get();
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) continue;
+            ServedSession* raw = s.get();
+            sessions_[fd] = std::move(s);
+            // Runs up to the read of the greeting
+            pump(raw, true);
+        }
+    }
+
+    // Runs the session as far as its input allows, then sends what it wrote
+    void pump(ServedSession* s, bool ok) {
+        while (ok && s->runnable()) s->resume();
+        if (ok) ok = s->flush();
+        if (!ok || (s->finished() && s->output.empty())) {
+            if (!s->finished()) {
+                // Dead peer: let the session run to its end so progress is saved
+                s->hang_up();
+                s->output.clear();
+                while (s->runnable()) { s->resume(); s->output.clear(); }
+            }
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s->fd(), nullptr);
+            sessions_.erase(s->fd());
+            return;
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP | (s->output.empty() ? 0u : (uint32_t)EPOLLOUT);
+        ev.data.ptr = s;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, s->fd(), &ev);
+    }
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    ucontext_t scheduler_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    std::mutex mutex_;
+    std::vector<int> incoming_;
+    std::unordered_map<int, std::unique_ptr<ServedSession>> sessions_;
+};
+
+int g_server_signal_pipe[2] = {-1, -1};
+
+void request_server_shutdown(int) {
+    char c = 0;
+    ssize_t ignored = ::write(g_server_signal_pipe[1], &c, 1);
+    (void)ignored;
+}
+
+int run_server(const std::string& path, int worker_count) {
+    sockaddr_un addr;
+    std::string error;
+    if (!unix_address(path, addr, &error)) { std::cerr << error << std::endl; return 1; }
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) { std::cerr << "socket: " << std::strerror(errno) << std::endl; return 1; }
+    // A socket file nobody answers on is left over from a previous server
+    if (::connect(listener, (sockaddr*)&addr, sizeof(addr)) == 0 || errno == EAGAIN) {
+        std::cerr << "A server is already listening on " << path << std::endl;
+        ::close(listener);
+        return 1;
+    }
+    ::close(listener);
+    ::unlink(path.c_str());
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0 || ::bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) ::close(listener);
+        return 1;
+    }
+
+    // Everything sessions share read-only is built before any worker runs;
+    // later content changes arrive as whole new catalogs
+    for (const LocaleInfo& info : kLocales) catalog_for(info.id);
+    g_catalog_watcher.start();
+    g_ui.animate = false;
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe2(g_server_signal_pipe, O_CLOEXEC) != 0) { std::cerr << "pipe: " << std::strerror(errno) << std::endl; return 1; }
+    signal(SIGINT, request_server_shutdown);
+    signal(SIGTERM, request_server_shutdown);
+
+    std::streambuf* console = std::cout.rdbuf();
+    SessionOutputBuffer routed(console);
+    std::cout.rdbuf(&routed);
+    std::vector<std::unique_ptr<ServerWorker>> workers;
+    for (int i = 0; i < worker_count; ++i) {
+        workers.emplace_back(new ServerWorker());
+        if (!workers.back()->start(&error)) {
+            std::cerr << error << std::endl;
+            workers.pop_back();
+            break;
+        }
+    }
+    int rc = 0;
+    if (workers.empty()) {
+        rc = 1;
+    } else {
+        std::cerr << "Serving on " << path << " with " << workers.size() << " worker(s)" << std::endl;
+        struct pollfd fds[2] = {{listener, POLLIN, 0}, {g_server_signal_pipe[0], POLLIN, 0}};
+        size_t next = 0;
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
                 break;
-            } else {
-                std::cout << loc->invalid_command << std::endl;
-                std::cin.get();
+            }
+            if (fds[1].revents) break;
+            for (;;) {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) break;
+                workers[next++ % workers.size()]->adopt(fd);
             }
         }
-        // End-of-level evaluation and quiz
-        if (!in_review_mode && !challenge_mode && lesson == lesson_count - 1) {
-            type_text("\033[1;35m🎓 Level Completed: " + loc->levels[level].name + "\033[0m", 25);
-            type_text("✅ You answered " + std::to_string(lesson_count) + "/" + std::to_string(lesson_count) + " challenges", 20);
-            type_text("🎯 XP Earned: " + std::to_string(xp), 20);
-            type_text("🏆 Great progress!", 20);
-            std::cout << "\nPress Enter to take the end-of-level quiz...\n";
-            std::cin.get();
-            run_end_of_level_quiz(loc->levels[level], xp, total_xp);
-            std::cout << "\nType retry to repeat the level, or next to proceed: ";
-            std::string end_input;
-            std::getline(std::cin, end_input);
-            if (end_input == "retry") { lesson = 0; continue; }
-            if (end_input == "next") break;
+    }
+    ::close(listener);
+    ::unlink(path.c_str());
+    workers.clear();
+    g_catalog_watcher.stop();
+    std::cout.rdbuf(console);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return rc;
+}
+#else
+int run_server(const std::string&, int) {
+    std::cerr << "--serve needs Linux (epoll)" << std::endl;
+    return 1;
+}
+#endif
+
+// --- Benchmarks ---
+// Built from this same file with -DLEARN_BENCHMARK:
+//   g++ -std=c++17 -O2 -pthread -DLEARN_BENCHMARK learn.cpp -o learn_bench
+// The result runs the hot paths instead of the tutor. Each benchmark is
+// warmed up and calibrated so that one sample takes at least a millisecond.
+// It is then timed over a fixed number of samples. Per-operation min,
+// median, p99 and mean times and heap allocations per operation are
+// printed as a table on stderr and as JSON on stdout, for comparing
+// releases. Everything runs against throwaway stores in a temporary
+// directory. Options: --filter <text> runs the benchmarks whose names
+// contain it; --samples <n> sets the sample count (default 100).
+#if defined(LEARN_BENCHMARK)
+std::atomic<uint64_t> g_allocations{0};
+
+// Kept out of line: inlined into callers, GCC mistakes the free() for a mismatch
+__attribute__((noinline)) void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+const double kBenchSampleNs = 1e6;
+const double kBenchWarmupNs = 2e8;
+
+struct BenchmarkResult {
+    std::string name;
+    uint64_t ops_per_sample = 0;
+    std::vector<double> ns_per_op;  // one per sample, sorted
+    double allocations_per_op = 0;
+
+    double percentile(double p) const { return ns_per_op[(size_t)((ns_per_op.size() - 1) * p)]; }
+    double mean() const { return std::accumulate(ns_per_op.begin(), ns_per_op.end(), 0.0) / ns_per_op.size(); }
+};
+
+template <typename Op>
+BenchmarkResult run_benchmark(const std::string& name, int samples, Op&& op) {
+    using Clock = std::chrono::steady_clock;
+    auto time_batch = [&op](uint64_t batch) {
+        auto started = Clock::now();
+        for (uint64_t i = 0; i < batch; ++i) op();
+        return std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+    };
+    // Warm caches and allocator pools while growing the batch to the sample length
+    uint64_t batch = 1;
+    auto warmup_started = Clock::now();
+    for (;;) {
+        double ns = time_batch(batch);
+        bool warm = std::chrono::duration<double, std::nano>(Clock::now() - warmup_started).count() >= kBenchWarmupNs;
+        if (ns < kBenchSampleNs && batch < ((uint64_t)1 << 32)) batch *= 2;
+        else if (warm) break;
+    }
+    BenchmarkResult result;
+    result.name = name;
+    result.ops_per_sample = batch;
+    uint64_t allocations = g_allocations.load();
+    for (int s = 0; s < samples; ++s) result.ns_per_op.push_back(time_batch(batch) / batch);
+    result.allocations_per_op = (double)(g_allocations.load() - allocations) / ((double)batch * samples);
+    std::sort(result.ns_per_op.begin(), result.ns_per_op.end());
+    return result;
+}
+
+void write_benchmark_json(std::ostream& out, const std::vector<BenchmarkResult>& results, int samples) {
+    out << std::fixed << std::setprecision(1)
+        << "{\n  \"format\": 1,\n  \"date\": \"" << get_current_date() << "\",\n  \"compiler\": \"" << json_escape(__VERSION__) << "\",\n"
+        << "  \"threads\": " << std::thread::hardware_concurrency() << ",\n  \"samples\": " << samples << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"ops_per_sample\": " << r.ops_per_sample
+            << ", \"min_ns\": " << r.percentile(0) << ", \"median_ns\": " << r.percentile(0.5) << ", \"p99_ns\": " << r.percentile(0.99)
+            << ", \"mean_ns\": " << r.mean() << std::setprecision(3) << ", \"allocations_per_op\": " << r.allocations_per_op
+            << std::setprecision(1) << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int run_benchmarks(int argc, char** argv) {
+    std::string filter;
+    int samples = 100;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (arg == "--samples" && i + 1 < argc) samples = std::max(1, atoi(argv[++i]));
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--filter <text>] [--samples <n>]" << std::endl;
+            return 1;
+        }
+    }
+    char dir[] = "/tmp/learn-bench-XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cerr << "Cannot make a benchmark directory: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    g_pack_dir = dir;
+    g_store_path = std::string(dir) + "/progress.db";
+    g_learner_id = "bench";
+    std::string error;
+    if (!g_progress_store.open(g_store_path, &error) || !g_notes.open(notes_base_path(), &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    // Prompts and pauses must not block, and screens go nowhere
+    g_batch.active = true;
+    g_ui.animate = false;
+    g_ui.clear = false;
+    NullBuffer null_buffer;
+    std::streambuf* console = std::cout.rdbuf(&null_buffer);
+
+    std::vector<BenchmarkResult> results;
+    auto bench = [&](const std::string& name, auto&& op) {
+        if (name.find(filter) == std::string::npos) return;
+        results.push_back(run_benchmark(name, samples, op));
+        const BenchmarkResult& r = results.back();
+        std::cerr << std::fixed << std::setprecision(1) << std::left << std::setw(28) << r.name << std::right
+                  << " min " << std::setw(10) << r.percentile(0) << " ns  median " << std::setw(10) << r.percentile(0.5)
+                  << " ns  p99 " << std::setw(10) << r.percentile(0.99) << " ns  " << std::setprecision(2)
+                  << r.allocations_per_op << " alloc/op" << std::endl;
+    };
+
+    // Catalog construction: built-in copy, overlay, answer keys and search index
+    for (const LocaleInfo& info : kLocales) {
+        int lang = info.id;
+        bench(std::string("catalog/build_") + info.code, [lang] {
+            std::string ignored;
+            std::shared_ptr<Localization> loc = build_catalog(lang, false, &ignored);
+        });
+    }
+
+    std::shared_ptr<Localization> catalog = current_catalog(1);
+    const Localization& loc = *catalog;
+
+    // Command dispatch: parsing a mix of commands, then parse plus handler
+    const char* const inputs[] = {"next", "back", "التالي", "notes here", "search vector push", "goto", "unknown text", "بحث حلقة"};
+    bench("dispatch/parse_command", [&inputs] {
+        for (const char* input : inputs) {
+            std::string_view args;
+            volatile Command id = parse_command(input, &args);
+            (void)id;
+        }
+    });
+    Progress progress;
+    bool review_mode = false, instructor_mode = false;
+    ReviewSchedule reviews;
+    int lesson_count = level_lesson_count(loc, 0);
+    bench("dispatch/lesson_command", [&] {
+        LessonView current = lesson_view(loc, progress.level, progress.lesson);
+        CommandContext context{progress, catalog.get(), current, lesson_count, review_mode, instructor_mode, reviews, {}};
+        Command command = parse_command(progress.lesson + 1 < lesson_count ? "next" : "back", &context.args);
+        if (progress.lesson + 1 >= lesson_count) progress.lesson = 0;
+        kCommandHandlers[(size_t)command](context);
+    });
+
+    // Grading: normalization alone, then typed answers against a precompiled key
+    const char* const answers[] = {"Using std::cout.", "  using   STD::COUT ", "باستخدام std::cout؟", "x is 5 or less", "completely wrong answer"};
+    std::u32string normalized;
+    bench("grading/normalize", [&] {
+        for (const char* answer : answers) normalize_answer(answer, normalized);
+    });
+    const AnswerKey& key = answer_key(loc, 0, 3);
+    bench("grading/accept_exact", [&key] { volatile bool ok = key.accepts("Using std::cout."); (void)ok; });
+    bench("grading/accept_typo", [&key] { volatile bool ok = key.accepts("usng std::cot"); (void)ok; });
+    bench("grading/reject", [&key] { volatile bool ok = key.accepts("completely wrong answer"); (void)ok; });
+
+    // Persistence: a save and a load of one learner's record
+    Progress saved;
+    saved.lang = 1;
+    bench("progress/save_load", [&] {
+        saved.xp++;
+        save_progress(saved);
+        Progress loaded;
+        load_progress(loaded);
+    });
+
+    // Notes against a large notes file
+    const int kBenchNotes = 50000;
+    for (int i = 0; i < kBenchNotes; ++i) save_note(1, i % 3, i % 6, "Note " + std::to_string(i) + ": remember the semicolon after a class definition");
+    bench("notes/save", [] { save_note(1, 0, 0, "Remember to include iostream for cin and cout."); });
+    bench("notes/display_lesson", [&loc] { display_notes(&loc, 1, 2, 5, true); });
+    bench("notes/display_all", [&loc] { display_notes(&loc, 1, 0, 0, false); });
+
+    // Rendering: composing and presenting a full lesson screen
+    LessonView current = lesson_view(loc, 1, 1);
+    bench("render/lesson_screen", [&] {
+        std::string& frame = screen().begin_frame();
+        compose_lesson_frame(frame, loc, current, "2/5", false, 3);
+        screen().present();
+    });
+
+    std::cout.rdbuf(console);
+    write_benchmark_json(std::cout, results, samples);
+    catalog.reset();
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+#if defined(LEARN_BENCHMARK)
+    return run_benchmarks(argc, argv);
+#endif
+    // --- Command Line ---
+    bool store_given = false;
+    bool batch_echo = false;
+    std::string transcript_path;
+    std::string serve_path;
+    std::string connect_path;
+    std::vector<std::string> import_dir;  // language, level, directory, output pack
+    bool analyze = false;
+    bool verify = false;
+    bool list_backups = false;
+    std::string restore_generation;
+    int backup_generations = 8;
+    std::string metrics_file;
+    int simulate_learners = 0, simulate_days = 0;
+    std::string simulate_from;
+    int worker_count = std::max(1, std::min(4, (int)std::thread::hardware_concurrency()));
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--pack-dir" && i + 1 < argc) {
+            g_pack_dir = argv[++i];
+        } else if (arg == "--store" && i + 1 < argc) {
+            g_store_path = argv[++i];
+            store_given = true;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            std::string script = argv[++i];
+            if (!load_batch_script(script)) { std::cerr << "Cannot read " << script << std::endl; return 1; }
+            g_batch.active = true;
+            g_ui.animate = false;
+            g_ui.clear = false;
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            g_batch.runs = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--transcript" && i + 1 < argc) {
+            transcript_path = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            worker_count = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--connect" && i + 1 < argc) {
+            connect_path = argv[++i];
+        } else if (arg == "--import-dir" && i + 4 < argc) {
+            import_dir.assign(argv + i + 1, argv + i + 5);
+            i += 4;
+        } else if (arg == "--simulate" && i + 2 < argc) {
+            simulate_learners = std::max(1, atoi(argv[++i]));
+            simulate_days = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--from" && i + 1 < argc) {
+            simulate_from = argv[++i];
+        } else if (arg == "--analyze") {
+            analyze = true;
+        } else if (arg == "--verify-catalog") {
+            verify = true;
+        } else if (arg == "--backups") {
+            list_backups = true;
+        } else if (arg == "--restore-backup" && i + 1 < argc) {
+            restore_generation = argv[++i];
+        } else if (arg == "--backup-generations" && i + 1 < argc) {
+            backup_generations = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (arg == "--fuzzy" && i + 1 < argc) {
+            g_match.tolerance_percent = std::max(0, std::min(100, atoi(argv[++i])));
+        } else if (arg == "--echo") {
+            batch_echo = true;
+        } else if (arg == "--learner" && i + 1 < argc) {
+            g_learner_id = argv[++i];
+            if (g_learner_id.empty() || g_learner_id.size() > kLearnerIdMax) {
+                std::cerr << "Learner id must be 1-" << kLearnerIdMax << " bytes" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--export-pack" && i + 2 < argc) {
+            std::string code = argv[++i];
+            std::string path = argv[++i];
+            const LocaleInfo* info = find_locale_code(code);
+            if (!info) { std::cerr << "Unknown language: " << code << " (" << locale_codes() << ")" << std::endl; return 1; }
+            if (!write_lesson_pack(*open_builtin_localization(*info->builtin), code, path)) { std::cerr << "Failed to write " << path << std::endl; return 1; }
+            std::cout << "Wrote " << path << std::endl;
+            return 0;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--learner <id>] [--store <file>] [--pack-dir <dir>] [--export-pack <" << locale_codes() << "> <file>]\n"
+                      << "       [--import-dir <" << locale_codes() << "> <level 1-3> <dir> <out.pack>] [--analyze] [--verify-catalog]\n"
+                      << "       [--backups] [--restore-backup <generation>] [--backup-generations <n>]\n"
+                      << "       [--metrics <file>] [--fuzzy <percent>] [--serve <socket> [--workers <n>]] [--connect <socket>]\n"
+                      << "       [--simulate <learners> <days> [--from <YYYY-MM-DD>]]\n"
+                      << "       [--batch <script|-> [--repeat <n>] [--transcript <file>] [--echo]]" << std::endl;
+            return 1;
+        }
+    }
+
+    // std::locale::global(std::locale("")); // Removed to avoid Windows locale error
+    // std::wcout.imbue(std::locale()); // Not needed
+    if (g_learner_id.empty()) g_learner_id = default_learner_id();
+    if (!import_dir.empty()) {
+        // Catalog (pack or built-in) plus a directory of lesson files, written as a new pack
+        const std::string& code = import_dir[0];
+        const LocaleInfo* info = find_locale_code(code);
+        if (!info) { std::cerr << "Unknown language: " << code << " (" << locale_codes() << ")" << std::endl; return 1; }
+        Localization* loc = catalog_for(info->id);
+        int level = atoi(import_dir[1].c_str()) - 1;
+        if (level < 0 || level >= level_count(*loc)) { std::cerr << "Level must be 1-" << level_count(*loc) << std::endl; return 1; }
+        ImportReport report = import_lesson_dir(import_dir[2], editable_level(*loc, level));
+        print_import_report(report, std::cout);
+        if (!write_lesson_pack(*loc, code, import_dir[3])) { std::cerr << "Failed to write " << import_dir[3] << std::endl; return 1; }
+        std::cout << "Wrote " << import_dir[3] << std::endl;
+        return report.errors.empty() ? 0 : 2;
+    }
+    // Event logs next to the progress store (--store), summarized per lesson
+    if (analyze) return analyze_events(events_dir_path());
+    if (!connect_path.empty()) return run_client(connect_path, g_learner_id);
+    if (!serve_path.empty() && g_batch.active) { std::cerr << "--serve and --batch cannot be combined" << std::endl; return 1; }
+    if (simulate_learners > 0) {
+        if (g_batch.active || !serve_path.empty()) { std::cerr << "--simulate cannot be combined with --batch or --serve" << std::endl; return 1; }
+        // Synthetic learners get their own stores unless told otherwise
+        if (!store_given) {
+            std::error_code ec;
+            std::filesystem::create_directories("simulation", ec);
+            g_store_path = "simulation/progress.db";
+        }
+        struct stat st;
+        if (stat(g_store_path.c_str(), &st) == 0 && st.st_size > 0) {
+            std::cerr << g_store_path << " already exists; remove it or name a new --store for the simulation" << std::endl;
+            return 1;
+        }
+        store_given = true;
+        g_batch.active = true;
+        g_ui.animate = false;
+        g_ui.clear = false;
+    }
+    g_snapshots.configure(g_store_path + ".snapshots", backup_generations);
+    g_compiler.configure(compile_cache_dir_path());
+    if (verify) return verify_catalog();
+    if (list_backups) {
+        std::vector<SnapshotInfo> snapshots = g_snapshots.list();
+        if (snapshots.empty()) std::cout << "No backups in " << g_snapshots.dir() << std::endl;
+        bool all_ok = true;
+        for (const SnapshotInfo& info : snapshots) {
+            const SnapshotHeader& h = info.header;
+            std::cout << std::setw(6) << h.generation << "  " << (h.time ? format_date(local_day(h.time)) : std::string(10, '-')) << "  ";
+            if (!info.ok) {
+                std::cout << "BAD: " << info.error << std::endl;
+                all_ok = false;
+                continue;
+            }
+            std::cout << (h.base ? "delta of " + std::to_string(h.base) : std::string("full")) << ", "
+                      << h.image_size << " bytes stored in " << h.payload_size << std::endl;
         }
+        return all_ok ? 0 : 2;
+    }
+    if (!restore_generation.empty()) {
+        std::string error;
+        if (!g_snapshots.restore(std::strtoull(restore_generation.c_str(), nullptr, 10), g_store_path, &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Restored " << g_store_path << " from backup " << restore_generation << std::endl;
+        return 0;
+    }
+    // Batch runs keep progress in memory unless a store is named explicitly
+    if (!g_batch.active || store_given) {
+        std::string store_error;
+        if (!g_progress_store.open(g_store_path, &store_error)) {
+            std::cerr << store_error << std::endl;
+            return 1;
+        }
+        if (!g_progress_journal.open(g_store_path + ".journal", &store_error)) {
+            std::cerr << store_error << " (saving synchronously)" << std::endl;
+        }
+        if (g_notes.open(notes_base_path(), &store_error)) {
+            if (g_learner_id == default_learner_id()) migrate_legacy_notes("notes.txt");
+        } else {
+            std::cerr << store_error << std::endl;
+        }
+        if (!g_events.open(events_dir_path(), &store_error)) std::cerr << store_error << std::endl;
+        if (!g_reviews.open(reviews_dir_path(), &store_error)) std::cerr << store_error << std::endl;
+        if (metrics_file.empty()) metrics_file = metrics_path();
+    }
+    // Latency histograms, dumped on exit and on SIGUSR1
+    if (!metrics_file.empty()) {
+        std::string metrics_error;
+        if (!g_metrics_exporter.start(metrics_file, &metrics_error)) std::cerr << metrics_error << std::endl;
+    }
+    if (simulate_learners > 0) {
+        int rc = run_simulation(simulate_learners, simulate_days, simulate_from);
+        g_metrics_exporter.stop();
+        g_snapshots.stop();
+        g_progress_journal.close();
+        return rc;
+    }
+    if (!serve_path.empty()) {
+        int rc = run_server(serve_path, worker_count);
+        g_metrics_exporter.stop();
+        g_snapshots.stop();
+        g_progress_journal.close();
+        return rc;
+    }
+    if (!g_batch.active) {
+        std::streambuf* terminal = std::cout.rdbuf();
+        LineCountingBuffer counting(terminal);
+        std::cout.rdbuf(&counting);
+        g_screen.attach(&counting);
+        g_terminal.start();
+        g_animator.start();
+#if defined(__linux__)
+        g_catalog_watcher.start();
+#endif
+        int rc = run_session();
+#if defined(__linux__)
+        g_catalog_watcher.stop();
+#endif
+        g_animator.stop();
+        g_terminal.stop();
+        std::cout.rdbuf(terminal);
+        g_metrics_exporter.stop();
+        g_snapshots.stop();
+        g_progress_journal.close();
+        return rc;
+    }
+
+    // Batch mode: replay the script, screen output discarded unless --echo
+    std::ofstream transcript_file;
+    std::ostream transcript(std::cout.rdbuf());
+    if (!transcript_path.empty()) {
+        transcript_file.open(transcript_path);
+        if (!transcript_file) { std::cerr << "Cannot write " << transcript_path << std::endl; return 1; }
+        transcript.rdbuf(transcript_file.rdbuf());
+    }
+    g_batch.transcript = &transcript;
+    NullBuffer null_buffer;
+    std::streambuf* screen = std::cout.rdbuf();
+    if (!batch_echo) std::cout.rdbuf(&null_buffer);
+    auto batch_started = std::chrono::steady_clock::now();
+    for (int run = 0; run < g_batch.runs; ++run) {
+        g_batch.next = 0;
+        run_session();
     }
+    double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - batch_started).count();
+    std::cout.rdbuf(screen);
+    transcript.flush();
+    write_batch_summary(std::cout, elapsed_us);
+    g_metrics_exporter.stop();
+    g_snapshots.stop();
+    g_progress_journal.close();
     return 0;
 } 
 
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Runs every tests/batch/*.script through learn --batch against a fresh
+# store and compares its transcript, without timings, to <name>.expected.
+# Usage: tests/run_batch_tests.sh [path/to/learn]
+learn=${1:-./learn}
+dir=$(dirname "$0")/batch
+failed=0
+for script in "$dir"/*.script; do
+    name=$(basename "$script" .script)
+    work=$(mktemp -d)
+    "$learn" --store "$work/progress.db" --pack-dir "$work" --batch "$script" --transcript "$work/transcript" >/dev/null 2>&1
+    grep '"seq"' "$work/transcript" | sed 's/,"us":[0-9.]*//' >"$work/actual"
+    if diff -u "$dir/$name.expected" "$work/actual"; then
+        echo "PASS $name"
+    else
+        echo "FAIL $name"
+        failed=1
+    fi
+    rm -rf "$work"
+done
+exit $failed